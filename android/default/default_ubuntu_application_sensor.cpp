@@ -21,22 +21,224 @@
 #include <ubuntu/application/sensors/proximity.h>
 #include <ubuntu/application/sensors/light.h>
 #include <ubuntu/application/sensors/orientation.h>
+#include <ubuntu/application/sensors/delivery.h>
+#include <ubuntu/application/sensors/decimation.h>
+#include <ubuntu/application/sensors/stats.h>
+#include <ubuntu/application/sensors/test_context.h>
 
 #include <private/application/sensors/sensor.h>
 #include <private/application/sensors/sensor_listener.h>
 #include <private/application/sensors/sensor_service.h>
 #include <private/application/sensors/sensor_type.h>
 #include <private/application/sensors/events.h>
+#include <private/application/sensors/decimator.h>
+#include <private/application/sensors/sensor_statistics.h>
+#include <private/platform/spsc_ring.h>
 
 #include <cassert>
+#include <cerrno>
 #include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
 
 namespace
 {
 
 enum sensor_value_t { MIN_DELAY, MIN_VALUE, MAX_VALUE, RESOLUTION };
+
+// Sensor timestamps are taken from CLOCK_MONOTONIC
+uint64_t monotonic_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+// A decoded reading, small enough to be copied through the deferred delivery queue
+struct QueuedReading
+{
+    int64_t timestamp;
+    float v[3];
+};
+
+// Everything a listener does independent of the type of its sensor: reducing
+// readings to the rate requested by the application, batching them and, in
+// deferred mode, queuing them up for the application thread. Every reading
+// handed over by the sensor service's looper is accounted for in statistics.
+struct BasicSensorListener : public ubuntu::application::sensors::SensorListener
+{
+    // Number of readings accumulated before a batch is handed out, even if
+    // the sensor service has not signalled the end of a drain yet.
+    static const uint32_t batch_capacity = 64;
+    // Readings buffered in deferred mode before new ones are dropped.
+    static const size_t queue_capacity = 256;
+
+    BasicSensorListener() : on_vector_batch(NULL),
+                            batch_context(nullptr),
+                            batch_count(0),
+                            mode(U_SENSORS_DELIVERY_IMMEDIATE),
+                            delivery_fd(-1),
+                            pending_signal(false)
+    {
+    }
+
+    ~BasicSensorListener()
+    {
+        if (delivery_fd >= 0)
+            close(delivery_fd);
+    }
+
+    void on_new_reading(const ubuntu::application::sensors::SensorReading::Ptr& reading)
+    {
+        statistics.record_received();
+
+        QueuedReading r;
+        r.timestamp = reading->timestamp;
+        if (!decimator.process(reading->timestamp, reading->vector.v, r.v))
+        {
+            statistics.record_decimated();
+            return;
+        }
+
+        if (__atomic_load_n(&mode, __ATOMIC_ACQUIRE) == U_SENSORS_DELIVERY_IMMEDIATE)
+        {
+            deliver(r);
+            return;
+        }
+
+        if (queue.push(r))
+            pending_signal = true;
+        else
+            statistics.record_dropped();
+    }
+
+    void on_readings_complete()
+    {
+        if (__atomic_load_n(&mode, __ATOMIC_ACQUIRE) == U_SENSORS_DELIVERY_IMMEDIATE)
+        {
+            flush_batch();
+            return;
+        }
+
+        // Wake up the consumer once per drain instead of once per reading
+        if (pending_signal)
+        {
+            static const uint64_t one = 1;
+            pending_signal = false;
+            if (write(delivery_fd, &one, sizeof(one)) < 0)
+                ALOGE("%s():%d: failed to signal pending readings", __PRETTY_FUNCTION__, __LINE__);
+        }
+    }
+
+    UStatus set_delivery_mode(UASensorsDeliveryMode new_mode)
+    {
+        if (new_mode == U_SENSORS_DELIVERY_DEFERRED && delivery_fd < 0)
+        {
+            delivery_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (delivery_fd < 0)
+                return U_STATUS_ERROR;
+        }
+
+        __atomic_store_n(&mode, new_mode, __ATOMIC_RELEASE);
+        return U_STATUS_SUCCESS;
+    }
+
+    uint32_t dispatch_pending()
+    {
+        // Reset readiness before draining, a reading queued afterwards signals again
+        uint64_t value;
+        if (delivery_fd >= 0 && read(delivery_fd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+            ALOGE("%s():%d: failed to reset delivery fd", __PRETTY_FUNCTION__, __LINE__);
+
+        uint32_t delivered = 0;
+        QueuedReading r;
+        while (queue.pop(r))
+        {
+            deliver(r);
+            ++delivered;
+        }
+
+        flush_batch();
+        return delivered;
+    }
+
+    void deliver(const QueuedReading& reading)
+    {
+        const uint64_t start = monotonic_now();
+        statistics.record_delivery(reading.timestamp, start);
+
+        if (on_vector_batch)
+        {
+            batch_timestamp[batch_count] = reading.timestamp;
+            batch_x[batch_count] = reading.v[0];
+            batch_y[batch_count] = reading.v[1];
+            batch_z[batch_count] = reading.v[2];
+
+            if (++batch_count == batch_capacity)
+                flush_batch();
+        }
+
+        if (on_reading(reading))
+            statistics.record_callback(monotonic_now() - start);
+    }
+
+    void flush_batch()
+    {
+        if (!on_vector_batch || batch_count == 0)
+            return;
+
+        UASVectorBatch batch;
+        batch.count = batch_count;
+        batch.timestamp = batch_timestamp;
+        batch.x = batch_x;
+        batch.y = batch_y;
+        batch.z = batch_z;
+
+        batch_count = 0;
+
+        const uint64_t start = monotonic_now();
+        on_vector_batch(&batch, this->batch_context);
+        statistics.record_callback(monotonic_now() - start);
+    }
+
+    UStatus set_decimation(uint64_t interval, UASensorsFilter filter, float cutoff)
+    {
+        if (!supports_filter(filter))
+            return U_STATUS_ERROR;
+
+        decimator.configure(interval, filter, cutoff);
+        return U_STATUS_SUCCESS;
+    }
+
+    /** Hands a single reading to the type specific callback, returns false if there is none. */
+    virtual bool on_reading(const QueuedReading& reading) = 0;
+
+    /** Whether readings of the sensor can be meaningfully combined by filter. */
+    virtual bool supports_filter(UASensorsFilter filter) const = 0;
+
+    ubuntu::application::sensors::Decimator decimator;
+    ubuntu::application::sensors::SensorStatistics statistics;
+
+    void (*on_vector_batch)(const UASVectorBatch*, void*);
+    void *batch_context;
+
+    uint32_t batch_count;
+    uint64_t batch_timestamp[batch_capacity];
+    float batch_x[batch_capacity];
+    float batch_y[batch_capacity];
+    float batch_z[batch_capacity];
+
+    int mode;
+    int delivery_fd;
+    bool pending_signal;
+    ubuntu::platform::SpscRing<QueuedReading, queue_capacity> queue;
+};
+
 template<ubuntu::application::sensors::SensorType sensor_type>
-struct SensorListener : public ubuntu::application::sensors::SensorListener
+struct SensorListener : public BasicSensorListener
 {
     SensorListener() : on_accelerometer_event(NULL),
                        on_proximity_event(NULL),
@@ -46,20 +248,20 @@ struct SensorListener : public ubuntu::application::sensors::SensorListener
     {
     }
 
-    void on_new_reading(const ubuntu::application::sensors::SensorReading::Ptr& reading)
+    bool on_reading(const QueuedReading& reading)
     {
         switch(sensor_type)
         {
             case ubuntu::application::sensors::sensor_type_orientation:
             {
                 if (!on_orientation_event)
-                    return;
+                    return false;
 
                 ubuntu::application::sensors::OrientationEvent ev(
-                        reading->timestamp,
-                        reading->vector[0],
-                        reading->vector[1],
-                        reading->vector[2]
+                        reading.timestamp,
+                        reading.v[0],
+                        reading.v[1],
+                        reading.v[2]
                         );
 
                 on_orientation_event(
@@ -71,13 +273,13 @@ struct SensorListener : public ubuntu::application::sensors::SensorListener
             case ubuntu::application::sensors::sensor_type_accelerometer:
             {
                 if (!on_accelerometer_event)
-                    return;
+                    return false;
 
                 ubuntu::application::sensors::AccelerometerEvent ev(
-                        reading->timestamp,
-                        reading->acceleration[0],
-                        reading->acceleration[1],
-                        reading->acceleration[2]
+                        reading.timestamp,
+                        reading.v[0],
+                        reading.v[1],
+                        reading.v[2]
                         );
 
                 on_accelerometer_event(
@@ -89,11 +291,11 @@ struct SensorListener : public ubuntu::application::sensors::SensorListener
             case ubuntu::application::sensors::sensor_type_proximity:
             {
                 if (!on_proximity_event)
-                    return;
+                    return false;
 
                 ubuntu::application::sensors::ProximityEvent ev(
-                        static_cast<uint64_t>(reading->timestamp),
-                        reading->distance
+                        static_cast<uint64_t>(reading.timestamp),
+                        reading.v[0]
                     );
 
                 on_proximity_event(
@@ -105,11 +307,11 @@ struct SensorListener : public ubuntu::application::sensors::SensorListener
             case ubuntu::application::sensors::sensor_type_light:
             {
                 if (!on_light_event)
-                    return;
+                    return false;
 
                 ubuntu::application::sensors::LightEvent ev(
-                        reading->timestamp,
-                        reading->light
+                        reading.timestamp,
+                        reading.v[0]
                     );
 
                 on_light_event(
@@ -119,6 +321,15 @@ struct SensorListener : public ubuntu::application::sensors::SensorListener
                 break;
             }
         }
+
+        return true;
+    }
+
+    bool supports_filter(UASensorsFilter filter) const
+    {
+        // Averaging discrete near/far readings yields neither
+        return sensor_type != ubuntu::application::sensors::sensor_type_proximity
+            || filter == U_SENSORS_FILTER_NONE;
     }
 
     on_accelerometer_event_cb on_accelerometer_event;
@@ -136,6 +347,63 @@ ubuntu::application::sensors::SensorListener::Ptr orientation_listener;
 ubuntu::application::sensors::SensorListener::Ptr accelerometer_listener;
 ubuntu::application::sensors::SensorListener::Ptr proximity_listener;
 ubuntu::application::sensors::SensorListener::Ptr light_listener;
+
+// Every sensor has exactly one listener, created and registered on first use
+template<ubuntu::application::sensors::SensorType sensor_type>
+SensorListener<sensor_type>* listener_for(
+    ubuntu::application::sensors::Sensor* sensor,
+    ubuntu::application::sensors::SensorListener::Ptr& listener)
+{
+    if (listener.get() == NULL)
+    {
+        listener = new SensorListener<sensor_type>();
+        sensor->register_listener(listener);
+    }
+
+    return static_cast<SensorListener<sensor_type>*>(listener.get());
+}
+
+BasicSensorListener* listener_for(ubuntu::application::sensors::Sensor* sensor)
+{
+    switch (sensor->type())
+    {
+    case ubuntu::application::sensors::sensor_type_accelerometer:
+        return listener_for<ubuntu::application::sensors::sensor_type_accelerometer>(sensor, accelerometer_listener);
+    case ubuntu::application::sensors::sensor_type_proximity:
+        return listener_for<ubuntu::application::sensors::sensor_type_proximity>(sensor, proximity_listener);
+    case ubuntu::application::sensors::sensor_type_light:
+        return listener_for<ubuntu::application::sensors::sensor_type_light>(sensor, light_listener);
+    case ubuntu::application::sensors::sensor_type_orientation:
+        return listener_for<ubuntu::application::sensors::sensor_type_orientation>(sensor, orientation_listener);
+    default:
+        return NULL;
+    }
+}
+
+// The listener of a sensor if it has been created, for calls that must not create one
+BasicSensorListener* find_listener(ubuntu::application::sensors::Sensor* sensor)
+{
+    ubuntu::application::sensors::SensorListener* listener;
+    switch (sensor->type())
+    {
+    case ubuntu::application::sensors::sensor_type_accelerometer:
+        listener = accelerometer_listener.get();
+        break;
+    case ubuntu::application::sensors::sensor_type_proximity:
+        listener = proximity_listener.get();
+        break;
+    case ubuntu::application::sensors::sensor_type_light:
+        listener = light_listener.get();
+        break;
+    case ubuntu::application::sensors::sensor_type_orientation:
+        listener = orientation_listener.get();
+        break;
+    default:
+        return NULL;
+    }
+
+    return static_cast<BasicSensorListener*>(listener);
+}
 }
 
 static int32_t toHz(int32_t microseconds)
@@ -262,13 +530,10 @@ ua_sensors_proximity_set_reading_cb(
     auto s = static_cast<ubuntu::application::sensors::Sensor*>(sensor);
 
     SensorListener<ubuntu::application::sensors::sensor_type_proximity>* sl
-        = new SensorListener<ubuntu::application::sensors::sensor_type_proximity>();
+        = listener_for<ubuntu::application::sensors::sensor_type_proximity>(s, proximity_listener);
 
     sl->on_proximity_event = cb;
     sl->context = ctx;
-
-    proximity_listener = sl;
-    s->register_listener(proximity_listener);
 }
 
 UStatus
@@ -287,6 +552,23 @@ ua_sensors_proximity_set_event_rate(
     return U_STATUS_SUCCESS;
 }
 
+UStatus
+ua_sensors_proximity_set_batching(
+    UASensorsProximity* sensor,
+    uint64_t period,
+    uint64_t max_latency)
+{
+    if (sensor == NULL)
+       return U_STATUS_ERROR;
+
+    ALOGI("%s():%d", __PRETTY_FUNCTION__, __LINE__);
+    auto s = static_cast<ubuntu::application::sensors::Sensor*>(sensor);
+    if (s->set_batching(period, max_latency) < 0)
+        return U_STATUS_ERROR;
+
+    return U_STATUS_SUCCESS;
+}
+
 uint64_t
 uas_proximity_event_get_timestamp(
     UASProximityEvent* event)
@@ -422,13 +704,10 @@ ua_sensors_light_set_reading_cb(
     auto s = static_cast<ubuntu::application::sensors::Sensor*>(sensor);
 
     SensorListener<ubuntu::application::sensors::sensor_type_light>* sl
-        = new SensorListener<ubuntu::application::sensors::sensor_type_light>();
+        = listener_for<ubuntu::application::sensors::sensor_type_light>(s, light_listener);
 
     sl->on_light_event = cb;
     sl->context = ctx;
-
-    light_listener = sl;
-    s->register_listener(light_listener);
 }
 
 UStatus
@@ -447,6 +726,23 @@ ua_sensors_light_set_event_rate(
     return U_STATUS_SUCCESS;
 }
 
+UStatus
+ua_sensors_light_set_batching(
+    UASensorsLight* sensor,
+    uint64_t period,
+    uint64_t max_latency)
+{
+    if (sensor == NULL)
+       return U_STATUS_ERROR;
+
+    ALOGI("%s():%d", __PRETTY_FUNCTION__, __LINE__);
+    auto s = static_cast<ubuntu::application::sensors::Sensor*>(sensor);
+    if (s->set_batching(period, max_latency) < 0)
+        return U_STATUS_ERROR;
+
+    return U_STATUS_SUCCESS;
+}
+
 uint64_t
 uas_light_event_get_timestamp(
     UASLightEvent* event)
@@ -582,13 +878,29 @@ ua_sensors_accelerometer_set_reading_cb(
     auto s = static_cast<ubuntu::application::sensors::Sensor*>(sensor);
 
     SensorListener<ubuntu::application::sensors::sensor_type_accelerometer>* sl
-        = new SensorListener<ubuntu::application::sensors::sensor_type_accelerometer>();
+        = listener_for<ubuntu::application::sensors::sensor_type_accelerometer>(s, accelerometer_listener);
 
     sl->on_accelerometer_event = cb;
     sl->context = ctx;
+}
+
+void
+ua_sensors_accelerometer_set_batch_reading_cb(
+    UASensorsAccelerometer* sensor,
+    on_accelerometer_batch_cb cb,
+    void *ctx)
+{
+    if (sensor == NULL)
+        return;
 
-    accelerometer_listener = sl;
-    s->register_listener(accelerometer_listener);
+    ALOGI("%s():%d", __PRETTY_FUNCTION__, __LINE__);
+    auto s = static_cast<ubuntu::application::sensors::Sensor*>(sensor);
+
+    SensorListener<ubuntu::application::sensors::sensor_type_accelerometer>* sl
+        = listener_for<ubuntu::application::sensors::sensor_type_accelerometer>(s, accelerometer_listener);
+
+    sl->on_vector_batch = cb;
+    sl->batch_context = ctx;
 }
 
 UStatus
@@ -607,6 +919,23 @@ ua_sensors_accelerometer_set_event_rate(
     return U_STATUS_SUCCESS;
 }
 
+UStatus
+ua_sensors_accelerometer_set_batching(
+    UASensorsAccelerometer* sensor,
+    uint64_t period,
+    uint64_t max_latency)
+{
+    if (sensor == NULL)
+       return U_STATUS_ERROR;
+
+    ALOGI("%s():%d", __PRETTY_FUNCTION__, __LINE__);
+    auto s = static_cast<ubuntu::application::sensors::Sensor*>(sensor);
+    if (s->set_batching(period, max_latency) < 0)
+        return U_STATUS_ERROR;
+
+    return U_STATUS_SUCCESS;
+}
+
 uint64_t
 uas_accelerometer_event_get_timestamp(
     UASAccelerometerEvent* event)
@@ -770,13 +1099,29 @@ ua_sensors_orientation_set_reading_cb(
     auto s = static_cast<ubuntu::application::sensors::Sensor*>(sensor);
 
     SensorListener<ubuntu::application::sensors::sensor_type_orientation>* sl
-        = new SensorListener<ubuntu::application::sensors::sensor_type_orientation>();
+        = listener_for<ubuntu::application::sensors::sensor_type_orientation>(s, orientation_listener);
 
     sl->on_orientation_event = cb;
     sl->context = ctx;
+}
 
-    orientation_listener = sl;
-    s->register_listener(orientation_listener);
+void
+ua_sensors_orientation_set_batch_reading_cb(
+    UASensorsOrientation* sensor,
+    on_orientation_batch_cb cb,
+    void *ctx)
+{
+    if (sensor == NULL)
+        return;
+
+    ALOGI("%s():%d", __PRETTY_FUNCTION__, __LINE__);
+    auto s = static_cast<ubuntu::application::sensors::Sensor*>(sensor);
+
+    SensorListener<ubuntu::application::sensors::sensor_type_orientation>* sl
+        = listener_for<ubuntu::application::sensors::sensor_type_orientation>(s, orientation_listener);
+
+    sl->on_vector_batch = cb;
+    sl->batch_context = ctx;
 }
 
 UStatus
@@ -795,6 +1140,23 @@ ua_sensors_orientation_set_event_rate(
     return U_STATUS_SUCCESS;
 }
 
+UStatus
+ua_sensors_orientation_set_batching(
+    UASensorsOrientation* sensor,
+    uint64_t period,
+    uint64_t max_latency)
+{
+    if (sensor == NULL)
+       return U_STATUS_ERROR;
+
+    ALOGI("%s():%d", __PRETTY_FUNCTION__, __LINE__);
+    auto s = static_cast<ubuntu::application::sensors::Sensor*>(sensor);
+    if (s->set_batching(period, max_latency) < 0)
+        return U_STATUS_ERROR;
+
+    return U_STATUS_SUCCESS;
+}
+
 uint64_t
 uas_orientation_event_get_timestamp(
     UASOrientationEvent* event)
@@ -844,3 +1206,170 @@ uas_orientation_event_get_roll(
 
     return U_STATUS_SUCCESS;
 }
+
+/*
+ * Deferred delivery
+ */
+
+UStatus
+ua_sensors_set_delivery_mode(
+    void* sensor,
+    UASensorsDeliveryMode mode)
+{
+    if (sensor == NULL)
+        return U_STATUS_ERROR;
+
+    ALOGI("%s():%d", __PRETTY_FUNCTION__, __LINE__);
+    auto s = static_cast<ubuntu::application::sensors::Sensor*>(sensor);
+    BasicSensorListener* sl = listener_for(s);
+    if (sl == NULL)
+        return U_STATUS_ERROR;
+
+    return sl->set_delivery_mode(mode);
+}
+
+int
+ua_sensors_get_delivery_fd(
+    void* sensor)
+{
+    if (sensor == NULL)
+        return -1;
+
+    auto s = static_cast<ubuntu::application::sensors::Sensor*>(sensor);
+    BasicSensorListener* sl = find_listener(s);
+    if (sl == NULL || sl->mode != U_SENSORS_DELIVERY_DEFERRED)
+        return -1;
+
+    return sl->delivery_fd;
+}
+
+uint32_t
+ua_sensors_dispatch_pending(
+    void* sensor)
+{
+    if (sensor == NULL)
+        return 0;
+
+    auto s = static_cast<ubuntu::application::sensors::Sensor*>(sensor);
+    BasicSensorListener* sl = find_listener(s);
+    if (sl == NULL)
+        return 0;
+
+    return sl->dispatch_pending();
+}
+
+uint64_t
+ua_sensors_get_dropped_readings(
+    void* sensor)
+{
+    if (sensor == NULL)
+        return 0;
+
+    auto s = static_cast<ubuntu::application::sensors::Sensor*>(sensor);
+    BasicSensorListener* sl = find_listener(s);
+    if (sl == NULL)
+        return 0;
+
+    return sl->statistics.dropped();
+}
+
+/*
+ * Decimation
+ */
+
+UStatus
+ua_sensors_set_decimation(
+    void* sensor,
+    uint64_t interval,
+    UASensorsFilter filter,
+    float cutoff)
+{
+    if (sensor == NULL)
+        return U_STATUS_ERROR;
+
+    ALOGI("%s():%d", __PRETTY_FUNCTION__, __LINE__);
+    auto s = static_cast<ubuntu::application::sensors::Sensor*>(sensor);
+    BasicSensorListener* sl = listener_for(s);
+    if (sl == NULL)
+        return U_STATUS_ERROR;
+
+    return sl->set_decimation(interval, filter, cutoff);
+}
+
+/*
+ * Statistics
+ */
+
+UStatus
+ua_sensors_get_stats(
+    void* sensor,
+    UASensorsStats* stats)
+{
+    if (sensor == NULL || stats == NULL)
+        return U_STATUS_ERROR;
+
+    auto s = static_cast<ubuntu::application::sensors::Sensor*>(sensor);
+    // a sensor without a listener has not delivered anything yet
+    BasicSensorListener* sl = find_listener(s);
+    if (sl != NULL)
+        sl->statistics.snapshot(stats);
+    else
+        memset(stats, 0, sizeof(*stats));
+
+    ubuntu::application::sensors::SensorService::Statistics service;
+    ubuntu::application::sensors::SensorService::statistics(service);
+    stats->wakeups = service.wakeups;
+    stats->wakeup_readings = service.readings;
+    stats->max_wakeup_readings = service.max_readings_per_wakeup;
+    stats->pool_high_water = service.pool_high_water;
+    stats->pool_exhausted = service.pool_exhausted;
+
+    return U_STATUS_SUCCESS;
+}
+
+/*
+ * Simulation contexts, only provided by the test backend
+ */
+
+UASensorsTestContext*
+ua_sensors_test_context_new(
+    const char*)
+{
+    return NULL;
+}
+
+UASensorsTestContext*
+ua_sensors_test_context_new_with_clock(
+    const char*,
+    UASensorsTestClock)
+{
+    return NULL;
+}
+
+void
+ua_sensors_test_context_destroy(
+    UASensorsTestContext*)
+{
+}
+
+UStatus
+ua_sensors_test_context_make_current(
+    UASensorsTestContext*)
+{
+    return U_STATUS_ERROR;
+}
+
+const char*
+ua_sensors_test_context_get_fifo_path(
+    UASensorsTestContext*)
+{
+    return NULL;
+}
+
+UStatus
+ua_sensors_test_context_advance_clock(
+    UASensorsTestContext*,
+    uint64_t)
+{
+    return U_STATUS_ERROR;
+}
@@ -101,6 +101,45 @@ include $(CLEAR_VARS)
 
 LOCAL_CFLAGS += -std=gnu++0x
 
+LOCAL_C_INCLUDES := \
+	$(UPAPI_PATH)/include \
+	$(UPAPI_PATH)/android/include
+
+LOCAL_SRC_FILES:= \
+	test_sensors_disabled.cpp \
+
+LOCAL_MODULE:= direct_ubuntu_application_sensors_disabled_for_hybris_test
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_SHARED_LIBRARIES := \
+	libubuntu_application_api
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_CFLAGS += -std=gnu++0x
+
+LOCAL_C_INCLUDES := \
+	$(UPAPI_PATH)/include \
+	$(UPAPI_PATH)/android/include
+
+LOCAL_SRC_FILES:= \
+	ubuntu_sensors_multiplexer.cpp \
+
+LOCAL_MODULE:= ubuntu_sensors_multiplexer
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_SHARED_LIBRARIES := \
+	libutils \
+	libubuntu_application_api
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_CFLAGS += -std=gnu++0x
+
 LOCAL_C_INCLUDES := \
 	$(UPAPI_PATH)/include \
 	$(UPAPI_PATH)/android/include
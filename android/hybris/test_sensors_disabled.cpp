@@ -0,0 +1,90 @@
+/*
+ * Copyright © 2013 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <atomic>
+
+#include <ubuntu/application/sensors/accelerometer.h>
+#include <ubuntu/application/sensors/orientation.h>
+
+/* The orientation sensor keeps the accelerometer of the HAL enabled, either
+ * directly or through the fused orientation sensor. A disabled application
+ * accelerometer must nevertheless not receive any readings. */
+
+static std::atomic<unsigned int> accelerometer_readings(0);
+static std::atomic<unsigned int> orientation_readings(0);
+
+void on_new_accelerometer_event(UASAccelerometerEvent*, void*)
+{
+    accelerometer_readings++;
+}
+
+void on_new_orientation_event(UASOrientationEvent*, void*)
+{
+    orientation_readings++;
+}
+
+int main(int argc, char** argv)
+{
+    UASensorsAccelerometer* accelerometer = ua_sensors_accelerometer_new();
+    UASensorsOrientation* orientation = ua_sensors_orientation_new();
+    if (accelerometer == NULL || orientation == NULL)
+    {
+        printf("SKIP: accelerometer or orientation sensor not available\n");
+        return EXIT_SUCCESS;
+    }
+
+    ua_sensors_accelerometer_set_reading_cb(accelerometer, on_new_accelerometer_event, NULL);
+    ua_sensors_orientation_set_reading_cb(orientation, on_new_orientation_event, NULL);
+
+    ua_sensors_orientation_enable(orientation);
+    ua_sensors_accelerometer_enable(accelerometer);
+    sleep(1);
+
+    if (accelerometer_readings == 0)
+    {
+        printf("FAIL: no accelerometer readings while enabled\n");
+        return EXIT_FAILURE;
+    }
+
+    ua_sensors_accelerometer_disable(accelerometer);
+    // a reading may be in flight while disabling
+    usleep(100000);
+    accelerometer_readings = 0;
+    orientation_readings = 0;
+    sleep(2);
+
+    printf("accelerometer readings while disabled: %u\n", accelerometer_readings.load());
+    printf("orientation readings: %u\n", orientation_readings.load());
+
+    if (accelerometer_readings != 0)
+    {
+        printf("FAIL: disabled accelerometer received readings\n");
+        return EXIT_FAILURE;
+    }
+
+    if (orientation_readings == 0)
+    {
+        printf("FAIL: no orientation readings\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("PASS\n");
+    return EXIT_SUCCESS;
+}
@@ -19,7 +19,10 @@
 
 #include <private/application/sensors/sensor_service.h>
 #include <private/application/sensors/sensor_listener.h>
+#include <private/application/sensors/orientation_fusion.h>
+#include <private/application/sensors/multiplexer.h>
 #include <private/application/sensors/sensor_reading.h>
+#include <private/application/sensors/sensor_reading_pool.h>
 #include <private/application/sensors/sensor_type.h>
 #include <private/application/sensors/sensor.h>
 
@@ -29,6 +32,11 @@
 #include <gui/SensorManager.h>
 #include <utils/KeyedVector.h>
 #include <utils/List.h>
+#include <utils/Mutex.h>
+#include <utils/Vector.h>
+
+#include <errno.h>
+#include <pthread.h>
 
 namespace ubuntu
 {
@@ -93,6 +101,18 @@ static const char* instance_package_name = init_instance_package_name();
 static const ForwardSensorTypeLut forward_sensor_type_lut = init_forward_sensor_type_lut();
 static const BackwardSensorTypeLut backward_sensor_type_lut = init_backward_sensor_type_lut();
 
+static const android::Sensor* default_sensor(ubuntu::application::sensors::SensorType type)
+{
+#if ANDROID_VERSION_MAJOR >= 7
+    return android::SensorManager::getInstanceForPackage(
+        android::String16(instance_package_name)).
+        getDefaultSensor(forward_sensor_type_lut.valueFor(type));
+#else
+    return android::SensorManager::getInstance().
+        getDefaultSensor(forward_sensor_type_lut.valueFor(type));
+#endif
+}
+
 
 struct Sensor : public ubuntu::application::sensors::Sensor
 {
@@ -101,7 +121,10 @@ struct Sensor : public ubuntu::application::sensors::Sensor
     Sensor(
         const android::Sensor* sensor,
         const android::sp<android::SensorEventQueue>& queue) : sensor(sensor),
-        sensor_event_queue(queue)
+        sensor_event_queue(queue),
+        enabled(false),
+        batch_period_ns(0),
+        batch_max_latency_ns(0)
     {
     };
 
@@ -110,6 +133,13 @@ struct Sensor : public ubuntu::application::sensors::Sensor
         return sensor->getHandle();
     }
 
+    // The HAL sensor may stay on for other users, the looper thread skips
+    // readings of a disabled sensor
+    bool is_enabled() const
+    {
+        return __atomic_load_n(&enabled, __ATOMIC_ACQUIRE);
+    }
+
     const char* name()
     {
         return sensor->getName().string();
@@ -120,10 +150,7 @@ struct Sensor : public ubuntu::application::sensors::Sensor
         return sensor->getVendor().string();
     }
 
-    void register_listener(const SensorListener::Ptr& listener)
-    {
-        listeners.push_back(listener);
-    }
+    void register_listener(const SensorListener::Ptr& listener);
 
     // Deprecated!
     const SensorListener::Ptr& registered_listener()
@@ -136,15 +163,8 @@ struct Sensor : public ubuntu::application::sensors::Sensor
         return listeners;
     }
 
-    int enable()
-    {
-        return sensor_event_queue->enableSensor(sensor);
-    }
-
-    int disable()
-    {
-        return sensor_event_queue->disableSensor(sensor);
-    }
+    int enable();
+    int disable();
 
     SensorType type()
     {
@@ -181,12 +201,218 @@ struct Sensor : public ubuntu::application::sensors::Sensor
         return sensor_event_queue->setEventRate(sensor, nsecs);
     }
 
+    int set_batching(int64_t period_ns, int64_t max_latency_ns)
+    {
+        if (period_ns < 0 || max_latency_ns < 0)
+            return android::BAD_VALUE;
+
+        batch_period_ns = period_ns;
+        batch_max_latency_ns = max_latency_ns;
+
+        // The configuration is picked up by enable() otherwise
+        if (!enabled)
+            return android::OK;
+
+        return enable_batched();
+    }
+
+    int enable_batched()
+    {
+#if ANDROID_VERSION_MAJOR >= 5 || (ANDROID_VERSION_MAJOR == 4 && ANDROID_VERSION_MINOR >= 4)
+        return sensor_event_queue->enableSensor(
+            sensor->getHandle(),
+            batch_period_ns / 1000,
+            batch_max_latency_ns / 1000,
+            0);
+#else
+        // No FIFO batching in the HAL, only honour the sampling period
+        int ret = sensor_event_queue->enableSensor(sensor);
+        if (ret < 0)
+            return ret;
+
+        return sensor_event_queue->setEventRate(sensor, batch_period_ns);
+#endif
+    }
+
     const android::Sensor* sensor;
     ubuntu::application::sensors::SensorListener::Ptr listener;
     android::List<ubuntu::application::sensors::SensorListener::Ptr> listeners;
     android::sp<android::SensorEventQueue> sensor_event_queue;
+    bool enabled;
+    int64_t batch_period_ns;
+    int64_t batch_max_latency_ns;
+};
+
+/** Virtual orientation sensor for devices whose HAL does not provide one.
+ *
+ * Fuses the accelerometer, magnetometer and, if present, gyroscope readings
+ * decoded by the SensorService. The fusion state is only touched by the
+ * looper thread.
+ */
+struct FusedOrientationSensor : public Sensor
+{
+    // Outside of the range of handles assigned by HALs.
+    static const int32_t handle = 0x7f000001;
+
+    FusedOrientationSensor(
+        const android::Sensor* accelerometer,
+        const android::Sensor* magnetometer,
+        const android::Sensor* gyroscope,
+        const android::sp<android::SensorEventQueue>& queue) : Sensor(accelerometer, queue),
+        accelerometer(accelerometer),
+        magnetometer(magnetometer),
+        gyroscope(gyroscope),
+        gyroscope_acquired(false),
+        active(false),
+        reset_pending(false)
+    {
+    }
+
+    int32_t id()
+    {
+        return handle;
+    }
+
+    const char* name()
+    {
+        return "Fused Orientation Sensor";
+    }
+
+    const char* vendor()
+    {
+        return "Ubuntu";
+    }
+
+    int enable();
+    int disable();
+
+    SensorType type()
+    {
+        return sensor_type_orientation;
+    }
+
+    float min_value()
+    {
+        return -180.f;
+    }
+
+    float max_value()
+    {
+        return 360.f;
+    }
+
+    float resolution()
+    {
+        return 0.1f;
+    }
+
+    int32_t min_delay()
+    {
+        return accelerometer->getMinDelay();
+    }
+
+    float power_consumption()
+    {
+        float power = accelerometer->getPowerUsage() + magnetometer->getPowerUsage();
+        if (gyroscope)
+            power += gyroscope->getPowerUsage();
+
+        return power;
+    }
+
+    // Readings are reported at the rate of the accelerometer.
+    int set_event_rate(uint32_t nsecs)
+    {
+        int ret = sensor_event_queue->setEventRate(accelerometer, nsecs);
+        if (ret < 0 || !gyroscope)
+            return ret;
+
+        return sensor_event_queue->setEventRate(gyroscope, nsecs);
+    }
+
+    int set_batching(int64_t, int64_t)
+    {
+        return android::INVALID_OPERATION;
+    }
+
+    /** Feeds an event into the filter, returns true if a new orientation has been computed. */
+    bool fuse(const ASensorEvent& event, float angles[3])
+    {
+        if (!__atomic_load_n(&active, __ATOMIC_ACQUIRE))
+            return false;
+
+        if (__atomic_exchange_n(&reset_pending, false, __ATOMIC_ACQ_REL))
+            fusion.reset();
+
+        if (event.sensor == magnetometer->getHandle())
+        {
+            fusion.update_magnetic(event.data);
+        } else if (gyroscope && event.sensor == gyroscope->getHandle())
+        {
+            fusion.update_gyroscope(event.timestamp, event.data);
+        } else if (event.sensor == accelerometer->getHandle())
+        {
+            if (!fusion.update_acceleration(event.timestamp, event.data))
+                return false;
+
+            fusion.orientation(angles);
+            return true;
+        }
+
+        return false;
+    }
+
+    const android::Sensor* accelerometer;
+    const android::Sensor* magnetometer;
+    const android::Sensor* gyroscope;
+    bool gyroscope_acquired;
+    bool active;
+    bool reset_pending;
+    OrientationFusion fusion;
 };
 
+/** Bookkeeping to verify that wakeups of a reading thread are amortized over
+ * several events. Written by the reading thread only, snapshots may be taken
+ * on any thread. */
+struct DrainStatistics
+{
+    DrainStatistics() : wakeups(0), events(0), max_events_per_wakeup(0)
+    {
+    }
+
+    void record_wakeup(uint64_t drained)
+    {
+        __atomic_store_n(&wakeups, wakeups + 1, __ATOMIC_RELAXED);
+        __atomic_store_n(&events, events + drained, __ATOMIC_RELAXED);
+        if (drained > max_events_per_wakeup)
+            __atomic_store_n(&max_events_per_wakeup, drained, __ATOMIC_RELAXED);
+    }
+
+    void add_to(ubuntu::application::sensors::SensorService::Statistics& stats) const
+    {
+        stats.wakeups += __atomic_load_n(&wakeups, __ATOMIC_RELAXED);
+        stats.readings += __atomic_load_n(&events, __ATOMIC_RELAXED);
+
+        const uint64_t max = __atomic_load_n(&max_events_per_wakeup, __ATOMIC_RELAXED);
+        if (max > stats.max_readings_per_wakeup)
+            stats.max_readings_per_wakeup = max;
+    }
+
+    uint64_t wakeups;
+    uint64_t events;
+    uint64_t max_events_per_wakeup;
+};
+
+template<size_t capacity>
+void add_pool_statistics(
+    const ubuntu::application::sensors::SensorReadingPool<capacity>& pool,
+    ubuntu::application::sensors::SensorService::Statistics& stats)
+{
+    if (pool.high_water_mark() > stats.pool_high_water)
+        stats.pool_high_water = pool.high_water_mark();
+    stats.pool_exhausted += pool.exhausted_count();
+}
+
 void print_vector(const ASensorVector& vec)
 {
     printf("Status: %d \n", vec.status);
@@ -195,8 +421,79 @@ void print_vector(const ASensorVector& vec)
     printf("\t\t %f, %f, %f \n", vec.azimuth, vec.pitch, vec.roll);
 }
 
+/** Immutable, flat lookup structure used on the event dispatch path.
+ *
+ * Sensors are indexed directly by their handle, all listeners are stored
+ * contiguously with every entry referring to its range. Tables are never
+ * modified once published, registration builds a new one instead. Handles
+ * beyond max_direct_handle are kept in a short overflow range that is
+ * searched linearly.
+ */
+struct DispatchTable
+{
+    static const int32_t max_direct_handle = 255;
+
+    struct Entry
+    {
+        Entry() : handle(-1), first_listener(0), listener_count(0)
+        {
+        }
+
+        int32_t handle;
+        // Keeps replaced sensors and their listeners alive until the table is released
+        Sensor::Ptr sensor;
+        size_t first_listener;
+        size_t listener_count;
+    };
+
+    DispatchTable(size_t direct_count, size_t overflow_count, size_t listener_count)
+        : entries(new Entry[direct_count + overflow_count]),
+          direct_count(direct_count),
+          overflow_count(overflow_count),
+          listeners(new ubuntu::application::sensors::SensorListener*[listener_count]),
+          listener_count(listener_count),
+          next_retired(NULL)
+    {
+    }
+
+    ~DispatchTable()
+    {
+        delete[] entries;
+        delete[] listeners;
+    }
+
+    const Entry* lookup(int32_t handle) const
+    {
+        if (handle >= 0 && size_t(handle) < direct_count)
+            return entries[handle].sensor.get() != NULL ? &entries[handle] : NULL;
+
+        for (size_t i = direct_count; i < direct_count + overflow_count; i++)
+            if (entries[i].handle == handle)
+                return &entries[i];
+
+        return NULL;
+    }
+
+    Entry* entries;
+    size_t direct_count;
+    size_t overflow_count;
+    ubuntu::application::sensors::SensorListener** listeners;
+    size_t listener_count;
+    // Intrusive link while waiting to be released by the looper thread
+    DispatchTable* next_retired;
+
+private:
+    DispatchTable(const DispatchTable&) = delete;
+    DispatchTable& operator=(const DispatchTable&) = delete;
+};
+
 struct SensorService : public ubuntu::application::sensors::SensorService
 {
+    // Maximum number of events pulled from the queue with a single read.
+    static const size_t event_buffer_size = 32;
+    // Number of preallocated readings handed out to listeners.
+    static const size_t reading_pool_size = 64;
+
     static int looper_callback(int receiveFd, int events, void* ctxt)
     {
         static const int success_and_continue = 1;
@@ -210,18 +507,55 @@ struct SensorService : public ubuntu::application::sensors::SensorService
         if (thiz->sensor_event_queue->getFd() != receiveFd)
             return success_and_continue;
 
-        static ASensorEvent event;
-        if (1 != thiz->sensor_event_queue->read(&event, 1))
+        // No table published before this point is referenced by the looper anymore
+        thiz->release_retired_tables();
+        const DispatchTable* table = __atomic_load_n(&thiz->dispatch_table, __ATOMIC_ACQUIRE);
+
+        // Drain everything that accumulated since the last wakeup. The fd
+        // of the queue is non-blocking, read() returns 0 once it is empty
+        // (BitTube maps EAGAIN to 0), negative values are errors.
+        size_t drained = 0;
+        ssize_t count = 0;
+        while ((count = thiz->sensor_event_queue->read(thiz->event_buffer, event_buffer_size)) > 0)
+        {
+            for (ssize_t i = 0; i < count; i++)
+                thiz->dispatch_event(table, thiz->event_buffer[i]);
+
+            drained += count;
+
+            if (size_t(count) < event_buffer_size)
+                break;
+        }
+
+        if (drained > 0)
+        {
+            thiz->notify_readings_complete(table);
+            thiz->drain_statistics.record_wakeup(drained);
+        }
+
+        // A wakeup that finds the queue empty is not an error, aborting would
+        // make the looper drop the fd and stop all sensor delivery
+        if (count < 0 && count != -EAGAIN)
             return error_and_abort;
 
-        ssize_t i = thiz->sensor_registry.indexOfKey(event.sensor);
-        if (i < 0)
-            return success_and_continue;
+        return success_and_continue;
+    }
 
-        Sensor::Ptr sensor = thiz->sensor_registry.valueAt(i);
+    void dispatch_event(const DispatchTable* table, const ASensorEvent& event)
+    {
+        if (!table)
+            return;
+
+        FusedOrientationSensor* fused = __atomic_load_n(&fused_orientation, __ATOMIC_ACQUIRE);
+        if (fused)
+            fuse_event(table, fused, event);
 
-        static ubuntu::application::sensors::SensorReading::Ptr reading(
-            new ubuntu::application::sensors::SensorReading());
+        const DispatchTable::Entry* entry = table->lookup(event.sensor);
+        if (!entry || entry->listener_count == 0 || !entry->sensor->is_enabled())
+            return;
+
+        // Every event gets its own reading, listeners are free to keep it.
+        ubuntu::application::sensors::SensorReading::Ptr reading = reading_pool.acquire();
 
         reading->timestamp = event.timestamp;
         switch (event.type)
@@ -268,15 +602,203 @@ struct SensorService : public ubuntu::application::sensors::SensorService
             break;
         }
 
+        dispatch_reading(table, entry, reading);
+    }
+
+    void fuse_event(const DispatchTable* table, FusedOrientationSensor* fused, const ASensorEvent& event)
+    {
+        float angles[3];
+        if (!fused->fuse(event, angles))
+            return;
+
+        const DispatchTable::Entry* entry = table->lookup(FusedOrientationSensor::handle);
+        if (!entry || entry->listener_count == 0 || !entry->sensor->is_enabled())
+            return;
+
+        ubuntu::application::sensors::SensorReading::Ptr reading = reading_pool.acquire();
+        reading->timestamp = event.timestamp;
+        memcpy(reading->vector.v, angles, sizeof(reading->vector.v));
+
+        dispatch_reading(table, entry, reading);
+    }
+
+    void dispatch_reading(
+        const DispatchTable* table,
+        const DispatchTable::Entry* entry,
+        const ubuntu::application::sensors::SensorReading::Ptr& reading)
+    {
         // Call all of the registered listeners
-        android::List<ubuntu::application::sensors::SensorListener::Ptr>::const_iterator it = sensor->registered_listeners().begin();
-        while (it != sensor->registered_listeners().end())
+        ubuntu::application::sensors::SensorListener* const* listener = table->listeners + entry->first_listener;
+        for (size_t i = 0; i < entry->listener_count; i++)
+            listener[i]->on_new_reading(reading);
+    }
+
+    /** Enables the HAL sensor for the first of its users. */
+    int acquire_sensor(const android::Sensor* sensor)
+    {
+        android::Mutex::Autolock lock(registry_guard);
+
+        const ssize_t i = enable_counts.indexOfKey(sensor->getHandle());
+        if (i >= 0 && enable_counts.valueAt(i) > 0)
         {
-            (*it)->on_new_reading(reading);
-            ++it;
+            enable_counts.editValueAt(i)++;
+            return android::OK;
         }
 
-        return success_and_continue;
+        int ret = sensor_event_queue->enableSensor(sensor);
+        if (ret < 0)
+            return ret;
+
+        enable_counts.add(sensor->getHandle(), 1);
+        return ret;
+    }
+
+    /** Disables the HAL sensor once its last user released it. */
+    int release_sensor(const android::Sensor* sensor)
+    {
+        android::Mutex::Autolock lock(registry_guard);
+
+        const ssize_t i = enable_counts.indexOfKey(sensor->getHandle());
+        if (i < 0 || enable_counts.valueAt(i) == 0)
+            return android::OK;
+
+        if (--enable_counts.editValueAt(i) > 0)
+            return android::OK;
+
+        return sensor_event_queue->disableSensor(sensor);
+    }
+
+    /** Returns the virtual orientation sensor, creating it on first use. */
+    Sensor::Ptr fused_orientation_sensor(
+        const android::Sensor* accelerometer,
+        const android::Sensor* magnetometer,
+        const android::Sensor* gyroscope)
+    {
+        FusedOrientationSensor* fused = __atomic_load_n(&fused_orientation, __ATOMIC_ACQUIRE);
+        if (fused)
+            return Sensor::Ptr(fused);
+
+        Sensor::Ptr p(new FusedOrientationSensor(accelerometer, magnetometer, gyroscope, sensor_event_queue));
+        // The registry keeps the sensor alive for the lifetime of the service
+        register_sensor(p);
+        __atomic_store_n(&fused_orientation, static_cast<FusedOrientationSensor*>(p.get()), __ATOMIC_RELEASE);
+
+        return p;
+    }
+
+    void notify_readings_complete(const DispatchTable* table)
+    {
+        if (!table)
+            return;
+
+        for (size_t i = 0; i < table->listener_count; i++)
+            table->listeners[i]->on_readings_complete();
+    }
+
+    /** Adds sensor to the registry, replacing a previously registered sensor with the same handle. */
+    void register_sensor(const Sensor::Ptr& sensor)
+    {
+        android::Mutex::Autolock lock(registry_guard);
+
+        bool replaced = false;
+        for (size_t i = 0; i < sensor_registry.size() && !replaced; i++)
+        {
+            if (sensor_registry[i]->id() == sensor->id())
+            {
+                sensor_registry.editItemAt(i) = sensor;
+                replaced = true;
+            }
+        }
+
+        if (!replaced)
+            sensor_registry.push_back(sensor);
+
+        publish_dispatch_table();
+    }
+
+    void register_listener(Sensor* sensor, const SensorListener::Ptr& listener)
+    {
+        android::Mutex::Autolock lock(registry_guard);
+
+        sensor->listeners.push_back(listener);
+        publish_dispatch_table();
+    }
+
+    // Requires registry_guard to be held.
+    void publish_dispatch_table()
+    {
+        size_t direct_count = 0;
+        size_t overflow_count = 0;
+        size_t listener_count = 0;
+
+        for (size_t i = 0; i < sensor_registry.size(); i++)
+        {
+            const int32_t handle = sensor_registry[i]->id();
+
+            if (handle >= 0 && handle <= DispatchTable::max_direct_handle)
+            {
+                if (size_t(handle) + 1 > direct_count)
+                    direct_count = handle + 1;
+            } else
+            {
+                overflow_count++;
+            }
+
+            listener_count += sensor_registry[i]->registered_listeners().size();
+        }
+
+        DispatchTable* table = new DispatchTable(direct_count, overflow_count, listener_count);
+
+        size_t next_overflow = direct_count;
+        size_t next_listener = 0;
+        for (size_t i = 0; i < sensor_registry.size(); i++)
+        {
+            const Sensor::Ptr& sensor = sensor_registry[i];
+            const int32_t handle = sensor->id();
+
+            DispatchTable::Entry& entry =
+                (handle >= 0 && handle <= DispatchTable::max_direct_handle) ?
+                table->entries[handle] : table->entries[next_overflow++];
+
+            entry.handle = handle;
+            entry.sensor = sensor;
+            entry.first_listener = next_listener;
+
+            android::List<ubuntu::application::sensors::SensorListener::Ptr>::const_iterator it = sensor->registered_listeners().begin();
+            while (it != sensor->registered_listeners().end())
+            {
+                table->listeners[next_listener++] = it->get();
+                ++it;
+            }
+
+            entry.listener_count = next_listener - entry.first_listener;
+        }
+
+        DispatchTable* previous = __atomic_exchange_n(&dispatch_table, table, __ATOMIC_ACQ_REL);
+        if (previous)
+        {
+            android::Mutex::Autolock lock(retired_guard);
+            previous->next_retired = retired_tables;
+            retired_tables = previous;
+        }
+    }
+
+    // Only called from the looper thread, outside of dispatching.
+    void release_retired_tables()
+    {
+        DispatchTable* table = NULL;
+        {
+            android::Mutex::Autolock lock(retired_guard);
+            table = retired_tables;
+            retired_tables = NULL;
+        }
+
+        while (table)
+        {
+            DispatchTable* next = table->next_retired;
+            delete table;
+            table = next;
+        }
     }
 
     SensorService() :
@@ -287,7 +809,10 @@ struct SensorService : public ubuntu::application::sensors::SensorService
         sensor_event_queue(android::SensorManager::getInstance().createEventQueue()),
 #endif
         looper(new android::Looper(false)),
-        event_loop(new ubuntu::application::EventLoop(looper))
+        event_loop(new ubuntu::application::EventLoop(looper)),
+        dispatch_table(NULL),
+        retired_tables(NULL),
+        fused_orientation(NULL)
     {
         looper->addFd(
             sensor_event_queue->getFd(),
@@ -303,44 +828,513 @@ struct SensorService : public ubuntu::application::sensors::SensorService
 #endif
     }
 
+    ~SensorService()
+    {
+        release_retired_tables();
+        delete dispatch_table;
+    }
+
     android::sp<android::SensorEventQueue> sensor_event_queue;
     android::sp<android::Looper> looper;
     android::sp<ubuntu::application::EventLoop> event_loop;
-    android::KeyedVector<int32_t, Sensor::Ptr> sensor_registry;
+    // Owns the sensors and thus their listeners, only touched when registering.
+    android::Vector<Sensor::Ptr> sensor_registry;
+    android::Mutex registry_guard;
+    // Published with release semantics, read by the looper thread only.
+    DispatchTable* dispatch_table;
+    DispatchTable* retired_tables;
+    android::Mutex retired_guard;
+    // Number of users per HAL sensor handle, guarded by registry_guard.
+    android::KeyedVector<int32_t, int> enable_counts;
+    FusedOrientationSensor* fused_orientation;
+    ASensorEvent event_buffer[event_buffer_size];
+    DrainStatistics drain_statistics;
+    ubuntu::application::sensors::SensorReadingPool<reading_pool_size> reading_pool;
 };
 
 ubuntu::platform::shared_ptr<SensorService> instance;
+
+// Sensor read through this process' own SensorEventQueue, defined below
+ubuntu::application::sensors::Sensor::Ptr local_sensor_for_type(SensorType type);
+
+/** Sensor whose readings are read from a multiplexer's shared memory ring.
+ *
+ * Rates and batching are owned by the multiplexer process. Listeners are only
+ * ever appended, so the client thread reads them without taking a lock. Should
+ * the multiplexer die, the sensor hands its listeners over to a local sensor
+ * and forwards all calls to it from then on.
+ */
+struct MultiplexedSensor : public ubuntu::application::sensors::Sensor
+{
+    typedef ubuntu::platform::shared_ptr<MultiplexedSensor> Ptr;
+
+    // Listeners are stored in chunks that are never moved once published
+    struct ListenerChunk
+    {
+        static const size_t size = 8;
+
+        ListenerChunk() : count(0), next(NULL)
+        {
+        }
+
+        SensorListener::Ptr listeners[size];
+        size_t count;
+        ListenerChunk* next;
+    };
+
+    MultiplexedSensor(SensorType sensor_type, const multiplexer::SensorDescription& description)
+        : sensor_type(sensor_type),
+          description(description),
+          enabled(false),
+          last_chunk(&listeners)
+    {
+        this->description.name[sizeof(this->description.name) - 1] = '\0';
+        this->description.vendor[sizeof(this->description.vendor) - 1] = '\0';
+    }
+
+    ~MultiplexedSensor()
+    {
+        ListenerChunk* chunk = listeners.next;
+        while (chunk != NULL)
+        {
+            ListenerChunk* next = chunk->next;
+            delete chunk;
+            chunk = next;
+        }
+    }
+
+    int32_t id()
+    {
+        return sensor_type;
+    }
+
+    const char* name()
+    {
+        return description.name;
+    }
+
+    const char* vendor()
+    {
+        return description.vendor;
+    }
+
+    void register_listener(const SensorListener::Ptr& listener)
+    {
+        android::Mutex::Autolock lock(guard);
+
+        if (local.get() != NULL)
+        {
+            local->register_listener(listener);
+            return;
+        }
+
+        if (last_chunk->count == ListenerChunk::size)
+        {
+            ListenerChunk* chunk = new ListenerChunk();
+            __atomic_store_n(&last_chunk->next, chunk, __ATOMIC_RELEASE);
+            last_chunk = chunk;
+        }
+
+        last_chunk->listeners[last_chunk->count] = listener;
+        __atomic_store_n(&last_chunk->count, last_chunk->count + 1, __ATOMIC_RELEASE);
+    }
+
+    int enable()
+    {
+        android::Mutex::Autolock lock(guard);
+
+        __atomic_store_n(&enabled, true, __ATOMIC_RELEASE);
+        return local.get() != NULL ? local->enable() : int(android::OK);
+    }
+
+    int disable()
+    {
+        android::Mutex::Autolock lock(guard);
+
+        __atomic_store_n(&enabled, false, __ATOMIC_RELEASE);
+        return local.get() != NULL ? local->disable() : int(android::OK);
+    }
+
+    SensorType type()
+    {
+        return sensor_type;
+    }
+
+    float min_value()
+    {
+        return description.min_value;
+    }
+
+    float max_value()
+    {
+        return description.max_value;
+    }
+
+    float resolution()
+    {
+        return description.resolution;
+    }
+
+    float power_consumption()
+    {
+        return description.power_consumption;
+    }
+
+    int set_event_rate(uint32_t nsecs)
+    {
+        android::Mutex::Autolock lock(guard);
+
+        return local.get() != NULL ? local->set_event_rate(nsecs) : int(android::INVALID_OPERATION);
+    }
+
+    int set_batching(int64_t period_ns, int64_t max_latency_ns)
+    {
+        android::Mutex::Autolock lock(guard);
+
+        if (local.get() == NULL)
+            return android::INVALID_OPERATION;
+
+        return local->set_batching(period_ns, max_latency_ns);
+    }
+
+    int32_t min_delay()
+    {
+        return description.min_delay;
+    }
+
+    void dispatch(const SensorReading::Ptr& reading)
+    {
+        if (!__atomic_load_n(&enabled, __ATOMIC_ACQUIRE))
+            return;
+
+        for (const ListenerChunk* chunk = &listeners; chunk != NULL; chunk = __atomic_load_n(&chunk->next, __ATOMIC_ACQUIRE))
+        {
+            const size_t count = __atomic_load_n(&chunk->count, __ATOMIC_ACQUIRE);
+            for (size_t i = 0; i < count; i++)
+                chunk->listeners[i]->on_new_reading(reading);
+        }
+    }
+
+    void notify_readings_complete()
+    {
+        for (const ListenerChunk* chunk = &listeners; chunk != NULL; chunk = __atomic_load_n(&chunk->next, __ATOMIC_ACQUIRE))
+        {
+            const size_t count = __atomic_load_n(&chunk->count, __ATOMIC_ACQUIRE);
+            for (size_t i = 0; i < count; i++)
+                chunk->listeners[i]->on_readings_complete();
+        }
+    }
+
+    /** Moves the listeners and the enable state over to sensor, called on the
+     * client thread once the multiplexer died. Without a local sensor of this
+     * type, the listeners stop receiving readings. */
+    void fall_back(const ubuntu::application::sensors::Sensor::Ptr& sensor)
+    {
+        android::Mutex::Autolock lock(guard);
+
+        if (sensor.get() == NULL)
+            return;
+
+        local = sensor;
+        for (const ListenerChunk* chunk = &listeners; chunk != NULL; chunk = chunk->next)
+            for (size_t i = 0; i < chunk->count; i++)
+                local->register_listener(chunk->listeners[i]);
+
+        if (enabled)
+            local->enable();
+    }
+
+    SensorType sensor_type;
+    multiplexer::SensorDescription description;
+    bool enabled;
+    android::Mutex guard;
+    ListenerChunk listeners;
+    // Guarded by guard
+    ListenerChunk* last_chunk;
+    ubuntu::application::sensors::Sensor::Ptr local;
+};
+
+/** Replaces the SensorService if a multiplexer process publishes the readings.
+ *
+ * Instead of a SensorEventQueue, Looper and EventLoop per process, a single
+ * thread waits on the shared ring and forwards readings to the sensors.
+ */
+struct MultiplexerClient
+{
+    static const size_t reading_pool_size = 64;
+    static const int liveness_check_ms = 1000;
+
+    static MultiplexerClient* open(const char* segment)
+    {
+        multiplexer::Subscriber* subscriber = multiplexer::Subscriber::open(segment);
+        if (!subscriber)
+            return NULL;
+
+        return new MultiplexerClient(subscriber);
+    }
+
+    ubuntu::application::sensors::Sensor::Ptr sensor_for_type(SensorType type)
+    {
+        android::Mutex::Autolock lock(guard);
+
+        if (fallen_back)
+            return local_sensor_for_type(type);
+
+        const multiplexer::SensorDescription& description = subscriber->meta().sensors[type];
+        if (!__atomic_load_n(&description.present, __ATOMIC_ACQUIRE))
+            return ubuntu::application::sensors::Sensor::Ptr();
+
+        if (sensors[type].get() == NULL)
+        {
+            MultiplexedSensor::Ptr p(new MultiplexedSensor(type, description));
+            sensors[type] = p;
+            __atomic_store_n(&published[type], p.get(), __ATOMIC_RELEASE);
+        }
+
+        if (!thread_started)
+            thread_started = pthread_create(&thread, NULL, run, this) == 0;
+
+        return ubuntu::application::sensors::Sensor::Ptr(sensors[type].get());
+    }
+
+    static void* run(void* context)
+    {
+        MultiplexerClient* thiz = static_cast<MultiplexerClient*>(context);
+
+        multiplexer::Reading r;
+        for (;;)
+        {
+            // A crashed multiplexer never wakes us up again
+            if (!thiz->subscriber->wait(liveness_check_ms) && !thiz->subscriber->publisher_alive())
+            {
+                thiz->fall_back();
+                return NULL;
+            }
+
+            uint64_t drained = 0;
+            while (thiz->subscriber->next(r))
+            {
+                if (r.type < first_defined_sensor_type || r.type >= undefined_sensor_type)
+                    continue;
+
+                MultiplexedSensor* sensor = __atomic_load_n(&thiz->published[r.type], __ATOMIC_ACQUIRE);
+                if (!sensor)
+                    continue;
+
+                SensorReading::Ptr reading = thiz->reading_pool.acquire();
+                reading->timestamp = r.timestamp;
+                memcpy(reading->vector.v, r.values, sizeof(reading->vector.v));
+
+                sensor->dispatch(reading);
+                drained++;
+            }
+
+            if (!drained)
+                continue;
+
+            thiz->drain_statistics.record_wakeup(drained);
+
+            for (int type = first_defined_sensor_type; type < undefined_sensor_type; type++)
+            {
+                MultiplexedSensor* sensor = __atomic_load_n(&thiz->published[type], __ATOMIC_ACQUIRE);
+                if (sensor)
+                    sensor->notify_readings_complete();
+            }
+        }
+
+        return NULL;
+    }
+
+    // Hands all sensors over to this process' own SensorEventQueue
+    void fall_back()
+    {
+        fprintf(stderr, "Sensor multiplexer died, reading sensors directly\n");
+
+        android::Mutex::Autolock lock(guard);
+
+        fallen_back = true;
+        for (int type = first_defined_sensor_type; type < undefined_sensor_type; type++)
+            if (sensors[type].get() != NULL)
+                sensors[type]->fall_back(local_sensor_for_type(SensorType(type)));
+    }
+
+    MultiplexerClient(multiplexer::Subscriber* subscriber)
+        : subscriber(subscriber),
+          thread_started(false),
+          fallen_back(false)
+    {
+        for (int type = first_defined_sensor_type; type < undefined_sensor_type; type++)
+            published[type] = NULL;
+    }
+
+    multiplexer::Subscriber* subscriber;
+    android::Mutex guard;
+    // Owned references, guarded by guard
+    MultiplexedSensor::Ptr sensors[undefined_sensor_type];
+    // Read by the client thread
+    MultiplexedSensor* published[undefined_sensor_type];
+    bool thread_started;
+    pthread_t thread;
+    // Set by the client thread once the multiplexer died, guarded by guard
+    bool fallen_back;
+    DrainStatistics drain_statistics;
+    ubuntu::application::sensors::SensorReadingPool<reading_pool_size> reading_pool;
+};
+
+// Never torn down, the client thread runs for the lifetime of the process.
+MultiplexerClient* multiplexer_client = NULL;
+
+void Sensor::register_listener(const SensorListener::Ptr& listener)
+{
+    // Sensors are only handed out after the service has been created
+    instance->register_listener(this, listener);
 }
 
-ubuntu::application::sensors::Sensor::Ptr ubuntu::application::sensors::SensorService::sensor_for_type(
-    ubuntu::application::sensors::SensorType type)
+int Sensor::enable()
 {
-    const android::Sensor* sensor =
+    if (!enabled)
+    {
+        int ret = instance->acquire_sensor(sensor);
+        if (ret < 0)
+            return ret;
 
-#if ANDROID_VERSION_MAJOR >= 7
-        android::SensorManager::getInstanceForPackage(
-            android::String16(hybris::instance_package_name)).
-            getDefaultSensor(hybris::forward_sensor_type_lut.valueFor(type));
-#else
-        android::SensorManager::getInstance().
-            getDefaultSensor(hybris::forward_sensor_type_lut.valueFor(type));
-#endif
+        __atomic_store_n(&enabled, true, __ATOMIC_RELEASE);
+    }
+
+    // a sampling period applies without FIFO batching too
+    if (batch_period_ns > 0 || batch_max_latency_ns > 0)
+        return enable_batched();
+
+    return android::OK;
+}
+
+int Sensor::disable()
+{
+    if (!enabled)
+        return android::OK;
+
+    __atomic_store_n(&enabled, false, __ATOMIC_RELEASE);
+    return instance->release_sensor(sensor);
+}
+
+int FusedOrientationSensor::enable()
+{
+    if (enabled)
+        return android::OK;
+
+    int ret = instance->acquire_sensor(accelerometer);
+    if (ret < 0)
+        return ret;
+
+    ret = instance->acquire_sensor(magnetometer);
+    if (ret < 0)
+    {
+        instance->release_sensor(accelerometer);
+        return ret;
+    }
+
+    // The filter degrades gracefully without a gyroscope
+    gyroscope_acquired = gyroscope && instance->acquire_sensor(gyroscope) >= 0;
+
+    __atomic_store_n(&enabled, true, __ATOMIC_RELEASE);
+    __atomic_store_n(&reset_pending, true, __ATOMIC_RELEASE);
+    __atomic_store_n(&active, true, __ATOMIC_RELEASE);
+    return android::OK;
+}
+
+int FusedOrientationSensor::disable()
+{
+    if (!enabled)
+        return android::OK;
+
+    __atomic_store_n(&enabled, false, __ATOMIC_RELEASE);
+    __atomic_store_n(&active, false, __ATOMIC_RELEASE);
+
+    if (gyroscope_acquired)
+        instance->release_sensor(gyroscope);
+    instance->release_sensor(magnetometer);
+    return instance->release_sensor(accelerometer);
+}
+
+// The client thread of a dead multiplexer creates sensors concurrently with the application
+android::Mutex local_guard;
+
+ubuntu::application::sensors::Sensor::Ptr local_sensor_for_type(SensorType type)
+{
+    android::Mutex::Autolock lock(local_guard);
+
+    const android::Sensor* sensor = default_sensor(type);
+
+    if (sensor == NULL && type == sensor_type_orientation)
+    {
+        // Fall back to fusing the raw sensors if the HAL lacks an orientation sensor
+        const android::Sensor* accelerometer = default_sensor(sensor_type_accelerometer);
+        const android::Sensor* magnetometer = default_sensor(sensor_type_magnetic_field);
+
+        if (accelerometer == NULL || magnetometer == NULL)
+            return ubuntu::application::sensors::Sensor::Ptr();
+
+        if (instance == NULL)
+            instance = new SensorService();
+
+        Sensor::Ptr p = instance->fused_orientation_sensor(
+            accelerometer,
+            magnetometer,
+            default_sensor(sensor_type_gyroscope));
+
+        return ubuntu::application::sensors::Sensor::Ptr(p.get());
+    }
 
     if (sensor == NULL)
-        return Sensor::Ptr();
+        return ubuntu::application::sensors::Sensor::Ptr();
 
-    if (hybris::instance == NULL)
-        hybris::instance = new hybris::SensorService();
+    if (instance == NULL)
+        instance = new SensorService();
 
-    hybris::Sensor::Ptr p(
-        new hybris::Sensor(
+    Sensor::Ptr p(
+        new Sensor(
             sensor,
-            hybris::instance->sensor_event_queue));
+            instance->sensor_event_queue));
 
     if (sensor)
-        hybris::instance->sensor_registry.add(p->id(), p);
+        instance->register_sensor(p);
 
-    return Sensor::Ptr(p.get());
+    return ubuntu::application::sensors::Sensor::Ptr(p.get());
+}
+}
+
+ubuntu::application::sensors::Sensor::Ptr ubuntu::application::sensors::SensorService::sensor_for_type(
+    ubuntu::application::sensors::SensorType type)
+{
+    if (const char* segment = multiplexer::segment_name())
+    {
+        if (hybris::multiplexer_client == NULL)
+            hybris::multiplexer_client = hybris::MultiplexerClient::open(segment);
+
+        // Fall back to accessing the sensors directly if the multiplexer is not running
+        if (hybris::multiplexer_client != NULL)
+            return hybris::multiplexer_client->sensor_for_type(type);
+    }
+
+    return hybris::local_sensor_for_type(type);
+}
+
+void ubuntu::application::sensors::SensorService::statistics(
+    ubuntu::application::sensors::SensorService::Statistics& stats)
+{
+    memset(&stats, 0, sizeof(stats));
+
+    // Both are created once and never torn down
+    if (hybris::instance != NULL)
+    {
+        hybris::instance->drain_statistics.add_to(stats);
+        hybris::add_pool_statistics(hybris::instance->reading_pool, stats);
+    }
+    if (hybris::multiplexer_client != NULL)
+    {
+        hybris::multiplexer_client->drain_statistics.add_to(stats);
+        hybris::add_pool_statistics(hybris::multiplexer_client->reading_pool, stats);
+    }
 }
 
 }
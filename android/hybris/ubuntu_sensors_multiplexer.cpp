@@ -0,0 +1,140 @@
+/*
+ * Copyright © 2013 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Owns the hardware sensors on behalf of all processes that set
+// UBUNTU_PLATFORM_API_SENSOR_MULTIPLEXER to the same segment name and
+// publishes their readings into shared memory.
+
+#include <private/application/sensors/multiplexer.h>
+#include <private/application/sensors/sensor_service.h>
+
+#include <private/application/sensors/sensor.h>
+#include <private/application/sensors/sensor_listener.h>
+#include <private/application/sensors/sensor_reading.h>
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <unistd.h>
+
+namespace uas = ubuntu::application::sensors;
+namespace mux = ubuntu::application::sensors::multiplexer;
+
+namespace
+{
+volatile sig_atomic_t quit = 0;
+
+void on_signal(int)
+{
+    quit = 1;
+}
+
+struct PublishingListener : public uas::SensorListener
+{
+    PublishingListener(uas::SensorType sensor_type, mux::Publisher* publisher)
+        : sensor_type(sensor_type),
+          publisher(publisher)
+    {
+    }
+
+    // All listeners are invoked on the sensor service's looper thread, which
+    // makes it the only writer of the ring.
+    void on_new_reading(const uas::SensorReading::Ptr& reading)
+    {
+        mux::Reading r;
+        r.timestamp = reading->timestamp;
+        r.type = sensor_type;
+        // Scalar readings alias the first vector element
+        memcpy(r.values, reading->vector.v, sizeof(r.values));
+
+        publisher->publish(r);
+    }
+
+    void on_readings_complete()
+    {
+        publisher->notify();
+    }
+
+    uas::SensorType sensor_type;
+    mux::Publisher* publisher;
+};
+}
+
+int main(int argc, char** argv)
+{
+    const char* segment = argc > 1 ? argv[1] : mux::segment_name();
+    if (segment == NULL)
+    {
+        fprintf(stderr, "Usage: %s <segment>, e.g. %s /ubuntu-sensors\n", argv[0], argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // Access the sensors directly instead of subscribing to ourselves
+    unsetenv(mux::segment_env);
+
+    mux::Publisher* publisher = mux::Publisher::create(segment);
+    if (publisher == NULL)
+    {
+        perror("Failed to create multiplexer segment");
+        return EXIT_FAILURE;
+    }
+
+    uas::Sensor::Ptr sensors[uas::undefined_sensor_type];
+
+    for (int i = uas::first_defined_sensor_type; i < uas::undefined_sensor_type; i++)
+    {
+        uas::SensorType type = static_cast<uas::SensorType>(i);
+
+        sensors[i] = uas::SensorService::sensor_for_type(type);
+        if (sensors[i].get() == NULL)
+            continue;
+
+        mux::SensorDescription& d = publisher->meta().sensors[i];
+        d.min_delay = sensors[i]->min_delay();
+        d.min_value = sensors[i]->min_value();
+        d.max_value = sensors[i]->max_value();
+        d.resolution = sensors[i]->resolution();
+        d.power_consumption = sensors[i]->power_consumption();
+        snprintf(d.name, sizeof(d.name), "%s", sensors[i]->name());
+        snprintf(d.vendor, sizeof(d.vendor), "%s", sensors[i]->vendor());
+        d.present = 1;
+
+        sensors[i]->register_listener(uas::SensorListener::Ptr(new PublishingListener(type, publisher)));
+        sensors[i]->enable();
+
+        printf("Publishing %s (%s)\n", d.name, d.vendor);
+    }
+
+    publisher->start();
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    while (!quit)
+        pause();
+
+    for (int i = uas::first_defined_sensor_type; i < uas::undefined_sensor_type; i++)
+        if (sensors[i].get() != NULL)
+            sensors[i]->disable();
+
+    // The looper thread might still be publishing, so only remove the name;
+    // clients fall back to direct access once they restart.
+    ubuntu::platform::detail::unlink_segment(segment);
+
+    return EXIT_SUCCESS;
+}
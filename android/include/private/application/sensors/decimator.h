@@ -0,0 +1,164 @@
+/*
+ * Copyright © 2013 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef UBUNTU_APPLICATION_SENSORS_DECIMATOR_H_
+#define UBUNTU_APPLICATION_SENSORS_DECIMATOR_H_
+
+#include <ubuntu/application/sensors/decimation.h>
+
+#include <cmath>
+#include <cstdint>
+
+namespace ubuntu
+{
+namespace application
+{
+namespace sensors
+{
+/** Reduces a stream of three-dimensional readings to a configurable rate.
+ *
+ * configure() may be called from any thread, process() only from the thread
+ * delivering the readings. A new configuration takes effect with the next
+ * reading and restarts the filter.
+ */
+class Decimator
+{
+public:
+    Decimator() : interval(0),
+                  filter(U_SENSORS_FILTER_NONE),
+                  cutoff(0.f),
+                  generation(0),
+                  applied_generation(0),
+                  active_interval(0),
+                  active_filter(U_SENSORS_FILTER_NONE),
+                  time_constant(0.f)
+    {
+        reset();
+    }
+
+    void configure(uint64_t new_interval, UASensorsFilter new_filter, float new_cutoff)
+    {
+        __atomic_store_n(&interval, new_interval, __ATOMIC_RELAXED);
+        __atomic_store_n(&filter, new_filter, __ATOMIC_RELAXED);
+        __atomic_store(&cutoff, &new_cutoff, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&generation, 1, __ATOMIC_RELEASE);
+    }
+
+    /** Feeds a reading into the filter, returns true if out holds a reading to be reported. */
+    bool process(int64_t timestamp, const float in[3], float out[3])
+    {
+        const uint32_t current = __atomic_load_n(&generation, __ATOMIC_ACQUIRE);
+        if (current != applied_generation)
+        {
+            applied_generation = current;
+            active_interval = __atomic_load_n(&interval, __ATOMIC_RELAXED);
+            active_filter = __atomic_load_n(&filter, __ATOMIC_RELAXED);
+
+            float fc;
+            __atomic_load(&cutoff, &fc, __ATOMIC_RELAXED);
+            if (fc <= 0.f && active_interval > 0)
+                fc = 0.5f * 1e9f / active_interval;
+            time_constant = fc > 0.f ? 1.f / (2.f * float(M_PI) * fc) : 0.f;
+
+            reset();
+        }
+
+        if (active_interval == 0 && (active_filter == U_SENSORS_FILTER_NONE || time_constant == 0.f))
+        {
+            for (int i = 0; i < 3; i++)
+                out[i] = in[i];
+
+            return true;
+        }
+
+        switch (active_filter)
+        {
+        case U_SENSORS_FILTER_BOXCAR:
+            for (int i = 0; i < 3; i++)
+                state[i] += in[i];
+            samples++;
+            break;
+        case U_SENSORS_FILTER_LOW_PASS:
+            if (last_input < 0 || time_constant == 0.f)
+            {
+                for (int i = 0; i < 3; i++)
+                    state[i] = in[i];
+            } else
+            {
+                const float dt = (timestamp - last_input) * 1e-9f;
+                const float alpha = dt / (time_constant + dt);
+                for (int i = 0; i < 3; i++)
+                    state[i] += alpha * (in[i] - state[i]);
+            }
+            last_input = timestamp;
+            break;
+        default:
+            for (int i = 0; i < 3; i++)
+                state[i] = in[i];
+            break;
+        }
+
+        if (last_output >= 0 && uint64_t(timestamp - last_output) < active_interval)
+            return false;
+
+        last_output = timestamp;
+
+        if (active_filter == U_SENSORS_FILTER_BOXCAR)
+        {
+            for (int i = 0; i < 3; i++)
+            {
+                out[i] = state[i] / samples;
+                state[i] = 0.f;
+            }
+            samples = 0;
+        } else
+        {
+            for (int i = 0; i < 3; i++)
+                out[i] = state[i];
+        }
+
+        return true;
+    }
+
+private:
+    void reset()
+    {
+        state[0] = state[1] = state[2] = 0.f;
+        samples = 0;
+        last_input = -1;
+        last_output = -1;
+    }
+
+    // Written by configure()
+    uint64_t interval;
+    UASensorsFilter filter;
+    float cutoff;
+    uint32_t generation;
+
+    // Only touched by process()
+    uint32_t applied_generation;
+    uint64_t active_interval;
+    UASensorsFilter active_filter;
+    float time_constant;
+    float state[3];
+    uint32_t samples;
+    int64_t last_input;
+    int64_t last_output;
+};
+}
+}
+}
+
+#endif // UBUNTU_APPLICATION_SENSORS_DECIMATOR_H_
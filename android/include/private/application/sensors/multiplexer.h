@@ -0,0 +1,85 @@
+/*
+ * Copyright © 2013 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef UBUNTU_APPLICATION_SENSORS_MULTIPLEXER_H_
+#define UBUNTU_APPLICATION_SENSORS_MULTIPLEXER_H_
+
+#include "private/application/sensors/sensor_type.h"
+#include "private/platform/broadcast_ring.h"
+
+#include <cstdint>
+#include <cstdlib>
+
+namespace ubuntu
+{
+namespace application
+{
+namespace sensors
+{
+/** Shared memory protocol between a sensor multiplexer and its clients.
+ *
+ * A single process owns the hardware sensors and publishes every decoded
+ * reading into one broadcast ring. Clients map the ring read-only and pick the
+ * readings of the sensor types they are interested in.
+ */
+namespace multiplexer
+{
+/** Name of the environment variable that selects the shared memory segment. */
+static const char* const segment_env = "UBUNTU_PLATFORM_API_SENSOR_MULTIPLEXER";
+
+/** Static properties of a multiplexed sensor. */
+struct SensorDescription
+{
+    uint32_t present;
+    int32_t min_delay;
+    float min_value;
+    float max_value;
+    float resolution;
+    float power_consumption;
+    char name[64];
+    char vendor[64];
+};
+
+/** Descriptions of all sensors, indexed by SensorType. */
+struct Description
+{
+    SensorDescription sensors[undefined_sensor_type];
+};
+
+/** A single decoded reading as it is laid out in shared memory. */
+struct Reading
+{
+    int64_t timestamp; ///< [ns], CLOCK_MONOTONIC
+    int32_t type; ///< SensorType of the originating sensor
+    float values[3]; ///< Vector readings, scalar readings use values[0]
+};
+
+static const size_t ring_capacity = 1024;
+
+typedef ubuntu::platform::BroadcastRingPublisher<Description, Reading, ring_capacity> Publisher;
+typedef ubuntu::platform::BroadcastRingSubscriber<Description, Reading, ring_capacity> Subscriber;
+
+/** The segment configured for this process, or NULL if multiplexing is disabled. */
+inline const char* segment_name()
+{
+    const char* name = getenv(segment_env);
+    return (name && *name) ? name : NULL;
+}
+}
+}
+}
+}
+
+#endif // UBUNTU_APPLICATION_SENSORS_MULTIPLEXER_H_
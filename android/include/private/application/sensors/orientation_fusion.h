@@ -0,0 +1,270 @@
+/*
+ * Copyright © 2013 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef UBUNTU_APPLICATION_SENSORS_ORIENTATION_FUSION_H_
+#define UBUNTU_APPLICATION_SENSORS_ORIENTATION_FUSION_H_
+
+#include <cmath>
+#include <cstdint>
+
+namespace ubuntu
+{
+namespace application
+{
+namespace sensors
+{
+/** Complementary filter that estimates a device's orientation from
+ * accelerometer, magnetometer and, if available, gyroscope readings.
+ *
+ * The attitude is kept as a unit quaternion rotating device coordinates into
+ * the world frame (east, north, up). Gyroscope readings propagate it, every
+ * accelerometer reading pulls it towards the absolute attitude given by
+ * gravity and the magnetic field. Without a gyroscope the filter degrades to
+ * a smoothed accelerometer/magnetometer solution.
+ *
+ * Units follow the Android conventions: m/s^2, rad/s, uT and ns timestamps.
+ * The kernel is plain float arithmetic on 3- and 4-element arrays without
+ * branches in the inner loops, which compilers vectorize well.
+ */
+class OrientationFusion
+{
+public:
+    /** Weight of the absolute attitude per accelerometer reading if gyroscope data is available. */
+    static constexpr float gyro_correction_gain = 0.02f;
+    /** Weight of the absolute attitude per accelerometer reading without gyroscope data. */
+    static constexpr float accel_mag_correction_gain = 0.3f;
+    /** Gyroscope readings older than this are not used for propagation, in [ns]. */
+    static constexpr int64_t gyro_timeout = 200000000;
+
+    OrientationFusion()
+    {
+        reset();
+    }
+
+    void reset()
+    {
+        q[0] = 1.f; q[1] = q[2] = q[3] = 0.f;
+        has_attitude = false;
+        has_magnetic = false;
+        last_gyro_timestamp = -1;
+        last_accel_timestamp = -1;
+    }
+
+    /** Propagates the attitude with the angular rate w given in device coordinates. */
+    void update_gyroscope(int64_t timestamp, const float w[3])
+    {
+        if (has_attitude && last_gyro_timestamp >= 0 && timestamp > last_gyro_timestamp
+            && timestamp - last_gyro_timestamp < gyro_timeout)
+        {
+            const float dt = (timestamp - last_gyro_timestamp) * 1e-9f;
+            // q' = q + dt/2 * q x (0, w)
+            const float dq[4] =
+            {
+                -q[1]*w[0] - q[2]*w[1] - q[3]*w[2],
+                 q[0]*w[0] + q[2]*w[2] - q[3]*w[1],
+                 q[0]*w[1] - q[1]*w[2] + q[3]*w[0],
+                 q[0]*w[2] + q[1]*w[1] - q[2]*w[0]
+            };
+
+            for (int i = 0; i < 4; i++)
+                q[i] += 0.5f * dt * dq[i];
+
+            normalize4(q);
+        }
+
+        last_gyro_timestamp = timestamp;
+    }
+
+    /** Records the most recent magnetic field vector. */
+    void update_magnetic(const float m[3])
+    {
+        for (int i = 0; i < 3; i++)
+            magnetic[i] = m[i];
+
+        has_magnetic = true;
+    }
+
+    /** Corrects the attitude with gravity, returns true if an orientation is available. */
+    bool update_acceleration(int64_t timestamp, const float a[3])
+    {
+        last_accel_timestamp = timestamp;
+
+        float measured[4];
+        if (!has_magnetic || !absolute_attitude(a, magnetic, measured))
+            return has_attitude;
+
+        if (!has_attitude)
+        {
+            for (int i = 0; i < 4; i++)
+                q[i] = measured[i];
+
+            has_attitude = true;
+            return true;
+        }
+
+        // Both q and -q describe the same rotation, blend along the shorter arc.
+        const float dot = q[0]*measured[0] + q[1]*measured[1] + q[2]*measured[2] + q[3]*measured[3];
+        const float sign = dot < 0.f ? -1.f : 1.f;
+        const float gain = correction_gain();
+
+        for (int i = 0; i < 4; i++)
+            q[i] += gain * (sign * measured[i] - q[i]);
+
+        normalize4(q);
+        return true;
+    }
+
+    /** Reports azimuth, pitch and roll in degrees, as defined for the legacy orientation sensor.
+     *
+     * Azimuth is the angle between magnetic north and the device's y axis in [0, 360),
+     * pitch the rotation around the x axis in [-180, 180] and roll the rotation
+     * around the y axis in [-90, 90].
+     */
+    void orientation(float angles[3]) const
+    {
+        static const float rad_to_deg = 180.f / float(M_PI);
+
+        // Rows of the device-to-world rotation: east, north and up in device coordinates
+        const float east_y = 2.f * (q[1]*q[2] - q[0]*q[3]);
+        const float north_y = 1.f - 2.f * (q[1]*q[1] + q[3]*q[3]);
+        const float up[3] =
+        {
+            2.f * (q[1]*q[3] - q[0]*q[2]),
+            2.f * (q[2]*q[3] + q[0]*q[1]),
+            1.f - 2.f * (q[1]*q[1] + q[2]*q[2])
+        };
+
+        float azimuth = std::atan2(east_y, north_y) * rad_to_deg;
+        if (azimuth < 0.f)
+            azimuth += 360.f;
+
+        angles[0] = azimuth;
+        angles[1] = std::atan2(-up[1], up[2]) * rad_to_deg;
+        angles[2] = std::asin(clamp(up[0], -1.f, 1.f)) * rad_to_deg;
+    }
+
+    /** The current attitude as unit quaternion (w, x, y, z). */
+    const float* attitude() const
+    {
+        return q;
+    }
+
+private:
+    float correction_gain() const
+    {
+        if (last_gyro_timestamp >= 0 && last_accel_timestamp - last_gyro_timestamp < gyro_timeout)
+            return gyro_correction_gain;
+
+        return accel_mag_correction_gain;
+    }
+
+    /** Attitude from gravity and magnetic field, fails in free fall or close to the magnetic poles. */
+    static bool absolute_attitude(const float a[3], const float m[3], float out[4])
+    {
+        float up[3] = { a[0], a[1], a[2] };
+        if (!normalize3(up))
+            return false;
+
+        float east[3];
+        cross(m, up, east);
+        if (!normalize3(east))
+            return false;
+
+        float north[3];
+        cross(up, east, north);
+
+        // Rows of R are east, north and up
+        const float r00 = east[0], r01 = east[1], r02 = east[2];
+        const float r10 = north[0], r11 = north[1], r12 = north[2];
+        const float r20 = up[0], r21 = up[1], r22 = up[2];
+
+        const float trace = r00 + r11 + r22;
+        if (trace > 0.f)
+        {
+            const float s = 2.f * std::sqrt(trace + 1.f);
+            out[0] = 0.25f * s;
+            out[1] = (r21 - r12) / s;
+            out[2] = (r02 - r20) / s;
+            out[3] = (r10 - r01) / s;
+        } else if (r00 > r11 && r00 > r22)
+        {
+            const float s = 2.f * std::sqrt(1.f + r00 - r11 - r22);
+            out[0] = (r21 - r12) / s;
+            out[1] = 0.25f * s;
+            out[2] = (r01 + r10) / s;
+            out[3] = (r02 + r20) / s;
+        } else if (r11 > r22)
+        {
+            const float s = 2.f * std::sqrt(1.f + r11 - r00 - r22);
+            out[0] = (r02 - r20) / s;
+            out[1] = (r01 + r10) / s;
+            out[2] = 0.25f * s;
+            out[3] = (r12 + r21) / s;
+        } else
+        {
+            const float s = 2.f * std::sqrt(1.f + r22 - r00 - r11);
+            out[0] = (r10 - r01) / s;
+            out[1] = (r02 + r20) / s;
+            out[2] = (r12 + r21) / s;
+            out[3] = 0.25f * s;
+        }
+
+        normalize4(out);
+        return true;
+    }
+
+    static void cross(const float a[3], const float b[3], float out[3])
+    {
+        out[0] = a[1]*b[2] - a[2]*b[1];
+        out[1] = a[2]*b[0] - a[0]*b[2];
+        out[2] = a[0]*b[1] - a[1]*b[0];
+    }
+
+    static bool normalize3(float v[3])
+    {
+        const float norm = std::sqrt(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+        if (norm < 1e-6f)
+            return false;
+
+        for (int i = 0; i < 3; i++)
+            v[i] /= norm;
+
+        return true;
+    }
+
+    static void normalize4(float v[4])
+    {
+        const float norm = std::sqrt(v[0]*v[0] + v[1]*v[1] + v[2]*v[2] + v[3]*v[3]);
+        for (int i = 0; i < 4; i++)
+            v[i] /= norm;
+    }
+
+    static float clamp(float value, float min, float max)
+    {
+        return value < min ? min : (value > max ? max : value);
+    }
+
+    float q[4];
+    float magnetic[3];
+    bool has_attitude;
+    bool has_magnetic;
+    int64_t last_gyro_timestamp;
+    int64_t last_accel_timestamp;
+};
+}
+}
+}
+
+#endif // UBUNTU_APPLICATION_SENSORS_ORIENTATION_FUSION_H_
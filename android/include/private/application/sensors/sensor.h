@@ -69,6 +69,10 @@ public:
     /** Set event delivery rate for the given sensor, in nanoseconds */
     virtual int set_event_rate(uint32_t nsecs) = 0;
 
+    /** Requests hardware batching: readings are sampled every period_ns and may be
+     * held in the sensor's FIFO for up to max_latency_ns before being reported. */
+    virtual int set_batching(int64_t period_ns, int64_t max_latency_ns) = 0;
+
     /** Returns the minimum delay between two consecutive sensor readings. */
     virtual int32_t min_delay() = 0;
 
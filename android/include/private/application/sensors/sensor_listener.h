@@ -35,10 +35,18 @@ public:
     typedef ubuntu::platform::shared_ptr<SensorListener> Ptr;
 
     /** Invoked whenever a new reading is available from the sensor.
+     *
+     * Every reading is a distinct object that is not modified as long as a
+     * reference to it is held, listeners may keep it beyond this call.
      * \param [in] reading The new reading.
      */
     virtual void on_new_reading(const SensorReading::Ptr& reading) = 0;
 
+    /** Invoked after all readings that became available together have been
+     * reported via on_new_reading. Listeners that accumulate readings flush them here.
+     */
+    virtual void on_readings_complete() {}
+
 protected:
     SensorListener() {}
     virtual ~SensorListener() {}
@@ -0,0 +1,144 @@
+/*
+ * Copyright © 2013 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef UBUNTU_APPLICATION_SENSORS_SENSOR_READING_POOL_H_
+#define UBUNTU_APPLICATION_SENSORS_SENSOR_READING_POOL_H_
+
+#include "private/application/sensors/sensor_reading.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ubuntu
+{
+namespace application
+{
+namespace sensors
+{
+/** A fixed-size pool of preallocated, reference counted readings.
+ *
+ * The pool keeps one reference to every reading it owns, a reading is free
+ * again once all other references have been released. Listeners may thus keep
+ * the readings they are handed for as long as they like, the pool never
+ * modifies a reading that is still referenced elsewhere. Slots are handed out
+ * round-robin, so a reading that has been released is only reused after all
+ * other free slots.
+ *
+ * acquire() must only be called from a single thread, references may be
+ * released from any thread. The counters may be read on any thread.
+ */
+template<size_t capacity>
+class SensorReadingPool
+{
+public:
+    SensorReadingPool() : next(0), until_sample(0), in_use(0), high_water(0), exhausted(0)
+    {
+        for (size_t i = 0; i < capacity; i++)
+            slots[i] = SensorReading::Ptr(new SensorReading());
+    }
+
+    /** Hands out a reading that is not referenced by anybody but the pool.
+     * Falls back to a heap allocated reading if all slots are in use.
+     */
+    SensorReading::Ptr acquire()
+    {
+        // Counting the busy slots costs a pass through the pool, so only do it
+        // once per capacity readings handed out.
+        if (until_sample == 0)
+        {
+            sample();
+            until_sample = capacity;
+        }
+        until_sample--;
+
+        // Released readings are usually found right at the cursor.
+        for (size_t i = 0; i < capacity; i++)
+        {
+            const size_t slot = next;
+            next = (next + 1) % capacity;
+
+            if (is_free(slot))
+                return slots[slot];
+        }
+
+        __atomic_store_n(&in_use, capacity, __ATOMIC_RELAXED);
+        __atomic_store_n(&high_water, capacity, __ATOMIC_RELAXED);
+        __atomic_store_n(&exhausted, exhausted + 1, __ATOMIC_RELAXED);
+        return SensorReading::Ptr(new SensorReading());
+    }
+
+    /** Number of preallocated readings. */
+    size_t size() const
+    {
+        return capacity;
+    }
+
+    /** Number of pooled readings that were referenced outside of the pool
+     * when last sampled, which happens once per size() calls of acquire(). */
+    size_t readings_in_use() const
+    {
+        return __atomic_load_n(&in_use, __ATOMIC_RELAXED);
+    }
+
+    /** Maximum number of pooled readings that have been sampled in use at the
+     * same time, size() once the pool has been exhausted. */
+    size_t high_water_mark() const
+    {
+        return __atomic_load_n(&high_water, __ATOMIC_RELAXED);
+    }
+
+    /** Number of readings that had to be heap allocated because the pool was exhausted. */
+    uint64_t exhausted_count() const
+    {
+        return __atomic_load_n(&exhausted, __ATOMIC_RELAXED);
+    }
+
+private:
+    SensorReadingPool(const SensorReadingPool&) = delete;
+    SensorReadingPool& operator=(const SensorReadingPool&) = delete;
+
+    void sample()
+    {
+        size_t busy = 0;
+        for (size_t i = 0; i < capacity; i++)
+            if (!is_free(i))
+                busy++;
+
+        __atomic_store_n(&in_use, busy, __ATOMIC_RELAXED);
+        if (busy > high_water)
+            __atomic_store_n(&high_water, busy, __ATOMIC_RELAXED);
+    }
+
+    bool is_free(size_t slot) const
+    {
+#ifdef ANDROID
+        return slots[slot]->getStrongCount() == 1;
+#else
+        return slots[slot].use_count() == 1;
+#endif
+    }
+
+    SensorReading::Ptr slots[capacity];
+    size_t next;
+    size_t until_sample;
+    size_t in_use;
+    size_t high_water;
+    uint64_t exhausted;
+};
+}
+}
+}
+
+#endif // UBUNTU_APPLICATION_SENSORS_SENSOR_READING_POOL_H_
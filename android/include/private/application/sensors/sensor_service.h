@@ -22,6 +22,8 @@
 
 #include "private/application/sensors/sensor.h"
 
+#include <cstdint>
+
 namespace ubuntu
 {
 namespace application
@@ -32,8 +34,21 @@ namespace sensors
 class SensorService : public ubuntu::platform::ReferenceCountedBase
 {
 public:
+    /** Counters of the thread that reads all readings of the process. */
+    struct Statistics
+    {
+        uint64_t wakeups;
+        uint64_t readings;
+        uint64_t max_readings_per_wakeup;
+        uint64_t pool_high_water;
+        uint64_t pool_exhausted;
+    };
+
     /** Returns a sensor instance for the provided type or NULL. */
     static Sensor::Ptr sensor_for_type(SensorType type);
+
+    /** Takes a snapshot of the counters, all 0 before the first sensor has been created. */
+    static void statistics(Statistics& stats);
 protected:
     SensorService() {}
     virtual ~SensorService() {}
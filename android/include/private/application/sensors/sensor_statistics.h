@@ -0,0 +1,124 @@
+/*
+ * Copyright © 2013 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef UBUNTU_APPLICATION_SENSORS_SENSOR_STATISTICS_H_
+#define UBUNTU_APPLICATION_SENSORS_SENSOR_STATISTICS_H_
+
+#include <ubuntu/application/sensors/stats.h>
+
+#include <cstdint>
+#include <cstring>
+
+namespace ubuntu
+{
+namespace application
+{
+namespace sensors
+{
+/** Collects the counters reported by ua_sensors_get_stats().
+ *
+ * Recording is a handful of relaxed atomic additions and may happen on
+ * several threads at once, e.g. the sensor thread receiving readings and the
+ * application thread dispatching deferred ones. Timestamps and the current
+ * time passed in must come from the same clock.
+ */
+class SensorStatistics
+{
+public:
+    SensorStatistics()
+    {
+        memset(&stats, 0, sizeof(stats));
+    }
+
+    void record_received()
+    {
+        add(stats.received, 1);
+    }
+
+    void record_decimated()
+    {
+        add(stats.decimated, 1);
+    }
+
+    void record_dropped()
+    {
+        add(stats.dropped, 1);
+    }
+
+    /** Accounts for a reading taken at timestamp whose callback started at now. */
+    void record_delivery(uint64_t timestamp, uint64_t now)
+    {
+        // Clocks might disagree slightly, e.g. after a suspend
+        const uint64_t latency = now > timestamp ? now - timestamp : 0;
+
+        add(stats.delivered, 1);
+        add(stats.latency_histogram[bucket(latency)], 1);
+        add(stats.total_latency, latency);
+        raise(stats.max_latency, latency);
+    }
+
+    /** Accounts for a single callback invocation that took duration. */
+    void record_callback(uint64_t duration)
+    {
+        add(stats.callbacks, 1);
+        add(stats.total_callback_time, duration);
+        raise(stats.max_callback_time, duration);
+    }
+
+    uint64_t dropped() const
+    {
+        return __atomic_load_n(&stats.dropped, __ATOMIC_RELAXED);
+    }
+
+    void snapshot(UASensorsStats* out) const
+    {
+        const uint64_t* from = reinterpret_cast<const uint64_t*>(&stats);
+        uint64_t* to = reinterpret_cast<uint64_t*>(out);
+        for (size_t i = 0; i < sizeof(stats) / sizeof(uint64_t); i++)
+            to[i] = __atomic_load_n(&from[i], __ATOMIC_RELAXED);
+    }
+
+private:
+    static unsigned int bucket(uint64_t latency)
+    {
+        const uint64_t us = latency / 1000;
+        if (us < 2)
+            return 0;
+
+        const unsigned int log2 = 63 - __builtin_clzll(us);
+        return log2 < U_SENSORS_LATENCY_BUCKETS ? log2 : U_SENSORS_LATENCY_BUCKETS - 1;
+    }
+
+    static void add(uint64_t& counter, uint64_t value)
+    {
+        __atomic_add_fetch(&counter, value, __ATOMIC_RELAXED);
+    }
+
+    static void raise(uint64_t& maximum, uint64_t value)
+    {
+        uint64_t current = __atomic_load_n(&maximum, __ATOMIC_RELAXED);
+        while (value > current
+               && !__atomic_compare_exchange_n(&maximum, &current, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        {
+        }
+    }
+
+    UASensorsStats stats;
+};
+}
+}
+}
+
+#endif // UBUNTU_APPLICATION_SENSORS_SENSOR_STATISTICS_H_
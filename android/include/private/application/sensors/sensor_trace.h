@@ -0,0 +1,117 @@
+/*
+ * Copyright © 2013 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef UBUNTU_APPLICATION_SENSORS_SENSOR_TRACE_H_
+#define UBUNTU_APPLICATION_SENSORS_SENSOR_TRACE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace ubuntu
+{
+namespace application
+{
+namespace sensors
+{
+/** Binary format of recorded sensor traces, played back by the test backend.
+ *
+ * A trace consists of a Header, a table of the recorded sensors and the
+ * records themselves, sorted by time. Everything is stored in the byte order
+ * of the machine that produced it and is meant to be memory mapped and used
+ * in place.
+ */
+namespace trace
+{
+static const char magic[8] = { 'U', 'A', 'S', 'T', 'R', 'A', 'C', 'E' };
+static const uint32_t version = 1;
+static const uint32_t byte_order_mark = 0x01020304;
+
+struct Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order; ///< byte_order_mark in the byte order of the producer
+    uint32_t sensor_count;
+    uint32_t record_size; ///< sizeof(Record)
+    uint64_t record_count;
+    uint64_t records_offset; ///< From the start of the file, a multiple of 8
+};
+
+/** Static properties of a recorded sensor, like given in a text format create command. */
+struct Sensor
+{
+    uint32_t type; ///< SensorType
+    float min_value;
+    float max_value;
+    float resolution;
+};
+
+struct Record
+{
+    uint64_t time; ///< [ns] since the start of the playback
+    uint32_t type; ///< SensorType of the originating sensor
+    float values[3]; ///< Vector readings, scalar readings use values[0], proximity readings a UASProximityDistance
+};
+
+/** Offset of the records behind a sensor table with sensor_count entries. */
+inline uint64_t records_offset(uint32_t sensor_count)
+{
+    const uint64_t end_of_table = sizeof(Header) + uint64_t(sensor_count) * sizeof(Sensor);
+    return (end_of_table + 7) & ~uint64_t(7);
+}
+
+/** Whether data starts like a trace, as opposed to the text format. */
+inline bool is_trace(const void* data, size_t size)
+{
+    return size >= sizeof(magic) && memcmp(data, magic, sizeof(magic)) == 0;
+}
+
+/** Validates the structure of a mapped trace, returns NULL or a description of the problem. */
+inline const char* check(const void* data, size_t size)
+{
+    if (!is_trace(data, size) || size < sizeof(Header))
+        return "not a sensor trace";
+
+    const Header* header = static_cast<const Header*>(data);
+    if (header->byte_order != byte_order_mark)
+        return "trace was recorded with a different byte order";
+    if (header->version != version || header->record_size != sizeof(Record))
+        return "unsupported trace version";
+    if (header->records_offset < records_offset(header->sensor_count) || header->records_offset % 8 != 0)
+        return "corrupt sensor table";
+    if (header->records_offset > size
+        || header->record_count > (size - header->records_offset) / sizeof(Record))
+        return "trace is truncated";
+
+    return NULL;
+}
+
+inline const Sensor* sensors(const void* data)
+{
+    return reinterpret_cast<const Sensor*>(static_cast<const char*>(data) + sizeof(Header));
+}
+
+inline const Record* records(const void* data)
+{
+    const Header* header = static_cast<const Header*>(data);
+    return reinterpret_cast<const Record*>(static_cast<const char*>(data) + header->records_offset);
+}
+}
+}
+}
+}
+
+#endif // UBUNTU_APPLICATION_SENSORS_SENSOR_TRACE_H_
@@ -0,0 +1,365 @@
+/*
+ * Copyright © 2013 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef UBUNTU_PLATFORM_BROADCAST_RING_H_
+#define UBUNTU_PLATFORM_BROADCAST_RING_H_
+
+#include <cerrno>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace ubuntu
+{
+namespace platform
+{
+/** Memory layout of a ring that one process publishes into and any number of
+ * processes read from. Meta is a trivially copyable block of data describing
+ * the published stream, T the trivially copyable element type.
+ */
+template<typename Meta, typename T, size_t capacity>
+struct BroadcastRingLayout
+{
+    static const uint32_t magic_value = 0x55534252; // "USBR"
+
+    struct Slot
+    {
+        // 2 * index + 1 while being written, 2 * index + 2 once complete
+        uint64_t sequence;
+        T value;
+    };
+
+    uint32_t magic;
+    uint32_t element_size;
+    uint32_t element_count;
+    // Futex word, bumped whenever the publisher notifies readers
+    uint32_t generation;
+    uint64_t write_index;
+    Meta meta;
+    Slot slots[capacity];
+    // Process id of the publisher while it is running, 0 once it stopped.
+    // Appended so that readers of the previous layout keep working.
+    int32_t publisher_pid;
+};
+
+namespace detail
+{
+// shm_open is not available in bionic, so segments are addressed by path instead.
+inline bool segment_path(const char* name, char* path, size_t size)
+{
+    const int n = snprintf(path, size, "/dev/shm/%s", name[0] == '/' ? name + 1 : name);
+    return n > 0 && size_t(n) < size;
+}
+
+inline int open_segment(const char* name, int flags, mode_t mode)
+{
+    char path[PATH_MAX];
+    if (!segment_path(name, path, sizeof(path)))
+        return -1;
+
+    return open(path, flags | O_CLOEXEC, mode);
+}
+
+inline void unlink_segment(const char* name)
+{
+    char path[PATH_MAX];
+    if (segment_path(name, path, sizeof(path)))
+        unlink(path);
+}
+
+inline void futex_wake(uint32_t* word)
+{
+    syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+inline void futex_wait(const uint32_t* word, uint32_t expected, const struct timespec* timeout)
+{
+    syscall(SYS_futex, word, FUTEX_WAIT, expected, timeout, NULL, 0);
+}
+}
+
+/** Writing side of a broadcast ring in a POSIX shared memory segment.
+ *
+ * Readers never block the publisher: slots are overwritten in order and each
+ * slot carries a sequence number that lets readers detect torn or lapped reads.
+ */
+template<typename Meta, typename T, size_t capacity>
+class BroadcastRingPublisher
+{
+public:
+    typedef BroadcastRingLayout<Meta, T, capacity> Layout;
+
+    /** Creates the segment called name below /dev/shm, returns NULL on failure.
+     *
+     * /dev/shm is writable by everyone, so a stale segment is replaced by a new
+     * file rather than reused: another user could have created it to feed
+     * forged readings to the clients, or as a symlink to a file of ours.
+     */
+    static BroadcastRingPublisher* create(const char* name)
+    {
+        detail::unlink_segment(name);
+        int fd = detail::open_segment(name, O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW, 0644);
+        if (fd < 0)
+            return NULL;
+
+        if (ftruncate(fd, sizeof(Layout)) < 0)
+        {
+            close(fd);
+            return NULL;
+        }
+
+        void* p = mmap(NULL, sizeof(Layout), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+
+        if (p == MAP_FAILED)
+            return NULL;
+
+        return new BroadcastRingPublisher(name, static_cast<Layout*>(p));
+    }
+
+    ~BroadcastRingPublisher()
+    {
+        __atomic_store_n(&layout->publisher_pid, 0, __ATOMIC_RELEASE);
+        munmap(layout, sizeof(Layout));
+        detail::unlink_segment(name);
+        delete[] name;
+    }
+
+    /** Accesses the descriptive block. Should be filled before calling start(),
+     * later modifications become visible to readers without any ordering guarantees. */
+    Meta& meta()
+    {
+        return layout->meta;
+    }
+
+    /** Makes the segment available to readers. */
+    void start()
+    {
+        __atomic_store_n(&layout->publisher_pid, int32_t(getpid()), __ATOMIC_RELAXED);
+        __atomic_store_n(&layout->magic, Layout::magic_value, __ATOMIC_RELEASE);
+    }
+
+    /** Appends value, readers are only woken up by notify(). */
+    void publish(const T& value)
+    {
+        const uint64_t index = layout->write_index;
+        typename Layout::Slot& slot = layout->slots[index % capacity];
+
+        __atomic_store_n(&slot.sequence, 2 * index + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        memcpy(&slot.value, &value, sizeof(T));
+        __atomic_store_n(&slot.sequence, 2 * index + 2, __ATOMIC_RELEASE);
+        __atomic_store_n(&layout->write_index, index + 1, __ATOMIC_RELEASE);
+
+        pending = true;
+    }
+
+    /** Wakes up all waiting readers if anything has been published since the last call. */
+    void notify()
+    {
+        if (!pending)
+            return;
+
+        pending = false;
+        __atomic_add_fetch(&layout->generation, 1, __ATOMIC_RELEASE);
+        detail::futex_wake(&layout->generation);
+    }
+
+private:
+    BroadcastRingPublisher(const char* segment, Layout* layout)
+        : name(new char[strlen(segment) + 1]),
+          layout(layout),
+          pending(false)
+    {
+        strcpy(name, segment);
+
+        memset(layout, 0, sizeof(Layout));
+        layout->element_size = sizeof(T);
+        layout->element_count = capacity;
+    }
+
+    BroadcastRingPublisher(const BroadcastRingPublisher&) = delete;
+    BroadcastRingPublisher& operator=(const BroadcastRingPublisher&) = delete;
+
+    char* name;
+    Layout* layout;
+    bool pending;
+};
+
+/** Reading side of a broadcast ring, maps the segment read-only.
+ *
+ * Every subscriber keeps its own cursor and starts with the elements published
+ * after it attached. Elements that were overwritten before they could be read
+ * are skipped and counted.
+ */
+template<typename Meta, typename T, size_t capacity>
+class BroadcastRingSubscriber
+{
+public:
+    typedef BroadcastRingLayout<Meta, T, capacity> Layout;
+
+    /** Attaches to the segment called name, returns NULL if there is no compatible, started publisher.
+     *
+     * Only segments that belong to root or to the effective user of this
+     * process and that nobody else can write to are trusted.
+     */
+    static BroadcastRingSubscriber* open(const char* name)
+    {
+        int fd = detail::open_segment(name, O_RDONLY | O_NOFOLLOW, 0);
+        if (fd < 0)
+            return NULL;
+
+        struct stat st;
+        if (fstat(fd, &st) < 0 || size_t(st.st_size) < sizeof(Layout)
+            || !S_ISREG(st.st_mode)
+            || (st.st_uid != 0 && st.st_uid != geteuid())
+            || (st.st_mode & (S_IWGRP | S_IWOTH)) != 0)
+        {
+            close(fd);
+            return NULL;
+        }
+
+        void* p = mmap(NULL, sizeof(Layout), PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+
+        if (p == MAP_FAILED)
+            return NULL;
+
+        const Layout* layout = static_cast<const Layout*>(p);
+        if (__atomic_load_n(&layout->magic, __ATOMIC_ACQUIRE) != Layout::magic_value
+            || layout->element_size != sizeof(T)
+            || layout->element_count != capacity)
+        {
+            munmap(p, sizeof(Layout));
+            return NULL;
+        }
+
+        return new BroadcastRingSubscriber(layout);
+    }
+
+    ~BroadcastRingSubscriber()
+    {
+        munmap(const_cast<Layout*>(layout), sizeof(Layout));
+    }
+
+    const Meta& meta() const
+    {
+        return layout->meta;
+    }
+
+    /** Copies the next element into value, returns false if there is none. */
+    bool next(T& value)
+    {
+        for (;;)
+        {
+            const uint64_t write_index = __atomic_load_n(&layout->write_index, __ATOMIC_ACQUIRE);
+            if (cursor == write_index)
+                return false;
+
+            // The publisher has been restarted
+            if (cursor > write_index)
+            {
+                cursor = write_index;
+                return false;
+            }
+
+            if (write_index - cursor > capacity)
+            {
+                overruns += write_index - capacity - cursor;
+                cursor = write_index - capacity;
+            }
+
+            const typename Layout::Slot& slot = layout->slots[cursor % capacity];
+            const uint64_t expected = 2 * cursor + 2;
+
+            const uint64_t before = __atomic_load_n(&slot.sequence, __ATOMIC_ACQUIRE);
+            memcpy(&value, &slot.value, sizeof(T));
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            const uint64_t after = __atomic_load_n(&slot.sequence, __ATOMIC_RELAXED);
+
+            cursor++;
+
+            if (before == expected && after == expected)
+                return true;
+
+            // The publisher lapped us while copying
+            overruns++;
+        }
+    }
+
+    /** Blocks until an element is available or timeout_ms elapsed, a negative timeout waits forever. */
+    bool wait(int timeout_ms)
+    {
+        const uint32_t generation = __atomic_load_n(&layout->generation, __ATOMIC_ACQUIRE);
+        if (cursor != __atomic_load_n(&layout->write_index, __ATOMIC_ACQUIRE))
+            return true;
+
+        struct timespec timeout;
+        timeout.tv_sec = timeout_ms / 1000;
+        timeout.tv_nsec = (timeout_ms % 1000) * 1000000L;
+
+        detail::futex_wait(&layout->generation, generation, timeout_ms < 0 ? NULL : &timeout);
+        return cursor != __atomic_load_n(&layout->write_index, __ATOMIC_ACQUIRE);
+    }
+
+    /** Checks whether the publishing process still exists. A publisher that
+     * crashed leaves the segment behind, so readers poll this when wait()
+     * times out. A recycled process id is mistaken for a live publisher. */
+    bool publisher_alive() const
+    {
+        const int32_t pid = __atomic_load_n(&layout->publisher_pid, __ATOMIC_ACQUIRE);
+        if (pid <= 0)
+            return false;
+
+        return kill(pid, 0) == 0 || errno == EPERM;
+    }
+
+    /** Number of elements that have been overwritten before they could be read. */
+    uint64_t overrun_count() const
+    {
+        return overruns;
+    }
+
+private:
+    BroadcastRingSubscriber(const Layout* layout)
+        : layout(layout),
+          cursor(__atomic_load_n(&layout->write_index, __ATOMIC_ACQUIRE)),
+          overruns(0)
+    {
+    }
+
+    BroadcastRingSubscriber(const BroadcastRingSubscriber&) = delete;
+    BroadcastRingSubscriber& operator=(const BroadcastRingSubscriber&) = delete;
+
+    const Layout* layout;
+    uint64_t cursor;
+    uint64_t overruns;
+};
+}
+}
+
+#endif // UBUNTU_PLATFORM_BROADCAST_RING_H_
@@ -0,0 +1,99 @@
+/*
+ * Copyright © 2013 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef UBUNTU_PLATFORM_SEQLOCK_H_
+#define UBUNTU_PLATFORM_SEQLOCK_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace ubuntu
+{
+namespace platform
+{
+/** Publishes a small value to any number of reader threads without locking them.
+ *
+ * Readers retry while a write is in progress and thus always see a complete
+ * value. Writers exclude each other by spinning, so writes should be short
+ * and not contended. The value is copied word by word with release stores
+ * and acquire loads instead of fences, which keeps concurrent readers free of
+ * data races in the sense of the memory model and visible to ThreadSanitizer.
+ * T needs to be trivially copyable.
+ */
+template<typename T>
+class SeqLock
+{
+public:
+    SeqLock() : sequence(0)
+    {
+        memset(words, 0, sizeof(words));
+    }
+
+    explicit SeqLock(const T& value) : sequence(0)
+    {
+        memset(words, 0, sizeof(words));
+        memcpy(words, &value, sizeof(T));
+    }
+
+    void store(const T& value)
+    {
+        uint32_t copy[word_count] = { 0 };
+        memcpy(copy, &value, sizeof(T));
+
+        // An odd sequence marks a write in progress
+        uint32_t s = __atomic_load_n(&sequence, __ATOMIC_RELAXED);
+        while ((s & 1) || !__atomic_compare_exchange_n(&sequence, &s, s + 1, true,
+                                                       __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            s = __atomic_load_n(&sequence, __ATOMIC_RELAXED);
+
+        for (size_t i = 0; i < word_count; i++)
+            __atomic_store_n(&words[i], copy[i], __ATOMIC_RELEASE);
+
+        __atomic_store_n(&sequence, s + 2, __ATOMIC_RELEASE);
+    }
+
+    T load() const
+    {
+        uint32_t copy[word_count];
+        uint32_t before, after;
+
+        do
+        {
+            before = __atomic_load_n(&sequence, __ATOMIC_ACQUIRE);
+            // Seeing any word of a newer write orders the second load after its start
+            for (size_t i = 0; i < word_count; i++)
+                copy[i] = __atomic_load_n(&words[i], __ATOMIC_ACQUIRE);
+            after = __atomic_load_n(&sequence, __ATOMIC_RELAXED);
+        } while ((before & 1) || before != after);
+
+        T value;
+        memcpy(&value, copy, sizeof(T));
+        return value;
+    }
+
+private:
+    static const size_t word_count = (sizeof(T) + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+
+    SeqLock(const SeqLock&) = delete;
+    SeqLock& operator=(const SeqLock&) = delete;
+
+    uint32_t sequence;
+    uint32_t words[word_count];
+};
+}
+}
+
+#endif // UBUNTU_PLATFORM_SEQLOCK_H_
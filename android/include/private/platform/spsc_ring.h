@@ -0,0 +1,94 @@
+/*
+ * Copyright © 2013 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef UBUNTU_PLATFORM_SPSC_RING_H_
+#define UBUNTU_PLATFORM_SPSC_RING_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ubuntu
+{
+namespace platform
+{
+/** A bounded, lock-free queue for exactly one producer and one consumer thread.
+ *
+ * The atomic builtins are used instead of std::atomic as the latter is not
+ * available with all of the Android toolchains this code is built with.
+ * T needs to be trivially copyable.
+ */
+template<typename T, size_t capacity>
+class SpscRing
+{
+public:
+    static_assert(capacity != 0 && (capacity & (capacity - 1)) == 0,
+                  "capacity must be a power of two");
+
+    SpscRing() : head(0), tail(0)
+    {
+    }
+
+    /** Enqueues a copy of value, returns false if the ring is full. Producer only. */
+    bool push(const T& value)
+    {
+        const size_t t = __atomic_load_n(&tail, __ATOMIC_RELAXED);
+        if (t - __atomic_load_n(&head, __ATOMIC_ACQUIRE) == capacity)
+            return false;
+
+        buffer[t & (capacity - 1)] = value;
+        __atomic_store_n(&tail, t + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    /** Dequeues the oldest element into value, returns false if the ring is empty. Consumer only. */
+    bool pop(T& value)
+    {
+        const size_t h = __atomic_load_n(&head, __ATOMIC_RELAXED);
+        if (h == __atomic_load_n(&tail, __ATOMIC_ACQUIRE))
+            return false;
+
+        value = buffer[h & (capacity - 1)];
+        __atomic_store_n(&head, h + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    /** Number of queued elements, exact only when called from one of the two sides. */
+    size_t size() const
+    {
+        return __atomic_load_n(&tail, __ATOMIC_ACQUIRE) - __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+private:
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    // Keep producer and consumer indices on separate cache lines to avoid false sharing
+    static const size_t cache_line_size = 64;
+
+    size_t head;
+    char head_padding[cache_line_size - sizeof(size_t)];
+    size_t tail;
+    char tail_padding[cache_line_size - sizeof(size_t)];
+    T buffer[capacity];
+};
+}
+}
+
+#endif // UBUNTU_PLATFORM_SPSC_RING_H_
@@ -21,6 +21,7 @@
 
 #include <ubuntu/visibility.h>
 
+#include <stddef.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
@@ -56,6 +57,51 @@ extern "C" {
     UBUNTU_DLL_PUBLIC void
     u_application_finish();
 
+    /**
+     * \brief Lists the modules whose functions are taken from the test backend.
+     * \ingroup application_support
+     *
+     * Modules such as sensors or location are routed to the test backend by
+     * naming them in $UBUNTU_PLATFORM_API_TEST_OVERRIDE, e.g. "sensors,location".
+     * \returns The number of overridden modules, which may exceed count.
+     * \param[out] modules Receives up to count module names, which stay valid
+     * until the process exits.
+     * \param[in] count The capacity of modules.
+     */
+    UBUNTU_DLL_PUBLIC size_t
+    u_application_list_overridden_modules(
+        const char** modules,
+        size_t count);
+
+    /**
+     * \brief Time spent in each phase of loading the backend.
+     * \ingroup application_support
+     */
+    typedef struct
+    {
+        uint64_t config_time; ///< [ns] looking up the backend in the configuration
+        uint64_t load_time; ///< [ns] loading the backend libraries
+        uint64_t bind_time; ///< [ns] resolving the backend functions
+        int resolved_now; ///< non-zero if all backend libraries were loaded with RTLD_NOW
+    } UApplicationPreloadTimes;
+
+    /**
+     * \brief Loads the backends of all modules and resolves their functions up front.
+     * \ingroup application_support
+     *
+     * Otherwise this happens on the first call into each module, which is then
+     * delayed accordingly. Setting $UBUNTU_PLATFORM_API_PRELOAD to a non-empty
+     * value preloads the backend as soon as the library is loaded and reports
+     * the times on stderr. Preloading again is cheap and reports the times of
+     * the initial load. Libraries that were loaded lazily by earlier calls
+     * into their modules are not reloaded, resolved_now tells whether that
+     * happened.
+     * \param[out] times Receives the time spent in each phase, may be NULL.
+     */
+    UBUNTU_DLL_PUBLIC void
+    u_application_preload_backend(
+        UApplicationPreloadTimes* times);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,67 @@
+/*
+ * Copyright © 2013 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UBUNTU_APPLICATION_SENSORS_DECIMATION_H_
+#define UBUNTU_APPLICATION_SENSORS_DECIMATION_H_
+
+#include <ubuntu/status.h>
+#include <ubuntu/visibility.h>
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /**
+     * \brief Selects how readings between two reported readings are combined.
+     * \ingroup sensor_access
+     */
+    typedef enum
+    {
+        U_SENSORS_FILTER_NONE, ///< Report the most recent reading, all others are discarded.
+        U_SENSORS_FILTER_BOXCAR, ///< Report the average of all readings since the last reported one.
+        U_SENSORS_FILTER_LOW_PASS ///< Report the output of a first-order low-pass filter fed with every reading.
+    } UASensorsFilter;
+
+    /**
+     * \brief Limits the rate at which the reading callbacks of a sensor are invoked.
+     * \ingroup sensor_access
+     *
+     * Unlike the ua_sensors_*_set_event_rate functions, which configure the
+     * hardware for every user of the sensor, this only affects the callbacks
+     * of the calling process. Readings arriving faster than the requested
+     * interval are combined according to filter.
+     *
+     * \returns U_STATUS_SUCCESS if successful or U_STATUS_ERROR if an error occured,
+     * e.g. when filtering the discrete readings of a proximity sensor.
+     * \param[in] sensor Any sensor instance obtained from one of the ua_sensors_*_new functions.
+     * \param[in] interval Minimum time between two reported readings in [ns], 0 reports every reading.
+     * \param[in] filter How readings are combined.
+     * \param[in] cutoff Cutoff frequency of U_SENSORS_FILTER_LOW_PASS in [Hz]; 0 selects half of the reporting rate.
+     */
+    UBUNTU_DLL_PUBLIC UStatus
+    ua_sensors_set_decimation(
+        void* sensor,
+        uint64_t interval,
+        UASensorsFilter filter,
+        float cutoff);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UBUNTU_APPLICATION_SENSORS_DECIMATION_H_ */
@@ -0,0 +1,97 @@
+/*
+ * Copyright © 2013 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UBUNTU_APPLICATION_SENSORS_DELIVERY_H_
+#define UBUNTU_APPLICATION_SENSORS_DELIVERY_H_
+
+#include <ubuntu/status.h>
+#include <ubuntu/visibility.h>
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /**
+     * \brief Selects the thread that reading callbacks are invoked on.
+     * \ingroup sensor_access
+     */
+    typedef enum
+    {
+        U_SENSORS_DELIVERY_IMMEDIATE, ///< Callbacks run on the internal sensor thread as soon as a reading arrives (default).
+        U_SENSORS_DELIVERY_DEFERRED ///< Readings are queued and callbacks run on the thread calling ua_sensors_dispatch_pending.
+    } UASensorsDeliveryMode;
+
+    /**
+     * \brief Switches the delivery mode of a sensor.
+     * \ingroup sensor_access
+     *
+     * In deferred mode the sensor thread only stores readings in a bounded,
+     * lock-free queue, so a slow consumer cannot stall sensor ingestion.
+     * Readings that do not fit into the queue are dropped and counted.
+     *
+     * \returns U_STATUS_SUCCESS if successful or U_STATUS_ERROR if an error occured.
+     * \param[in] sensor Any sensor instance obtained from one of the ua_sensors_*_new functions.
+     * \param[in] mode The new delivery mode.
+     */
+    UBUNTU_DLL_PUBLIC UStatus
+    ua_sensors_set_delivery_mode(
+        void* sensor,
+        UASensorsDeliveryMode mode);
+
+    /**
+     * \brief Queries a file descriptor that becomes readable whenever deferred readings are pending.
+     * \ingroup sensor_access
+     *
+     * The descriptor is owned by the sensor and is meant to be integrated with
+     * a main loop; ua_sensors_dispatch_pending resets its readiness.
+     *
+     * \returns The file descriptor or -1 if the sensor is not in deferred mode.
+     * \param[in] sensor The sensor instance to be queried.
+     */
+    UBUNTU_DLL_PUBLIC int
+    ua_sensors_get_delivery_fd(
+        void* sensor);
+
+    /**
+     * \brief Invokes the reading callbacks for all queued readings on the calling thread.
+     * \ingroup sensor_access
+     *
+     * Must only be called from one thread at a time per sensor.
+     *
+     * \returns The number of readings that have been delivered.
+     * \param[in] sensor The sensor instance to be dispatched.
+     */
+    UBUNTU_DLL_PUBLIC uint32_t
+    ua_sensors_dispatch_pending(
+        void* sensor);
+
+    /**
+     * \brief Queries the number of readings dropped because the deferred queue was full.
+     * \ingroup sensor_access
+     * \returns The number of dropped readings since the sensor has been created.
+     * \param[in] sensor The sensor instance to be queried.
+     */
+    UBUNTU_DLL_PUBLIC uint64_t
+    ua_sensors_get_dropped_readings(
+        void* sensor);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UBUNTU_APPLICATION_SENSORS_DELIVERY_H_ */
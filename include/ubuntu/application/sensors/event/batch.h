@@ -0,0 +1,48 @@
+/*
+ * Copyright © 2013 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UBUNTU_APPLICATION_SENSORS_BATCH_EVENT_H_
+#define UBUNTU_APPLICATION_SENSORS_BATCH_EVENT_H_
+
+#include <ubuntu/visibility.h>
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /**
+     * \brief A window of consecutive three-axis readings, stored as a structure of arrays.
+     * \ingroup sensor_access
+     *
+     * All arrays hold \a count elements and are only valid for the duration
+     * of the callback invocation that hands out the batch.
+     */
+    typedef struct
+    {
+        uint32_t count; ///< Number of readings in the batch.
+        const uint64_t* timestamp; ///< Timestamps of the readings, same timebase as the per-event accessors.
+        const float* x; ///< First component of the readings, e.g., acceleration in x-axis direction or azimuth.
+        const float* y; ///< Second component of the readings, e.g., acceleration in y-axis direction or pitch.
+        const float* z; ///< Third component of the readings, e.g., acceleration in z-axis direction or roll.
+    } UASVectorBatch;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UBUNTU_APPLICATION_SENSORS_BATCH_EVENT_H_ */
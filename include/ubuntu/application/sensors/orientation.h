@@ -23,6 +23,7 @@
 #include <ubuntu/visibility.h>
 
 #include <ubuntu/application/sensors/event/orientation.h>
+#include <ubuntu/application/sensors/event/batch.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -41,6 +42,13 @@ extern "C" {
     typedef void (*on_orientation_event_cb)(UASOrientationEvent* event,
                                               void* context);
 
+    /**
+     * \brief Callback type used by applications to subscribe to batches of orientation readings.
+     * \ingroup sensor_access
+     */
+    typedef void (*on_orientation_batch_cb)(const UASVectorBatch* batch,
+                                            void* context);
+
     /**
      * \brief Create a new object for accessing the orientation sensor.
      * \ingroup sensor_access
@@ -137,6 +145,44 @@ extern "C" {
         UASensorsOrientation* sensor,
         uint32_t rate);
 
+    /**
+     * \brief Request batched delivery of sensor readings from the hardware FIFO.
+     * \ingroup sensor_access
+     *
+     * Readings are sampled every \a period nanoseconds and may be held back for up
+     * to \a max_latency nanoseconds before being reported, which allows the system
+     * to sleep in between. A \a max_latency of 0 requests continuous delivery.
+     * Sensors without a hardware FIFO only honour the sampling period.
+     *
+     * \returns U_STATUS_SUCCESS if successful or U_STATUS_ERROR if an error occured.
+     * \param[in] sensor The sensor instance to be modified.
+     * \param[in] period The sampling period in nanoseconds.
+     * \param[in] max_latency The maximum report latency in nanoseconds.
+     */
+    UBUNTU_DLL_PUBLIC UStatus
+    ua_sensors_orientation_set_batching(
+        UASensorsOrientation* sensor,
+        uint64_t period,
+        uint64_t max_latency);
+
+    /**
+     * \brief Set the callback to be invoked with batches of sensor readings.
+     * \ingroup sensor_access
+     *
+     * Readings that become available together are handed out in a single
+     * invocation instead of one callback per reading. The callback is
+     * independent of the one installed with ua_sensors_orientation_set_reading_cb.
+     *
+     * \param[in] sensor The sensor instance to associate the callback with.
+     * \param[in] cb The callback to be invoked.
+     * \param[in] ctx The context supplied to the callback invocation.
+     */
+    UBUNTU_DLL_PUBLIC void
+    ua_sensors_orientation_set_batch_reading_cb(
+        UASensorsOrientation* sensor,
+        on_orientation_batch_cb cb,
+        void *ctx);
+
 #ifdef __cplusplus
 }
 #endif
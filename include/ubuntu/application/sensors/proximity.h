@@ -137,6 +137,26 @@ extern "C" {
         UASensorsProximity* sensor,
         uint32_t rate);
 
+    /**
+     * \brief Request batched delivery of sensor readings from the hardware FIFO.
+     * \ingroup sensor_access
+     *
+     * Readings are sampled every \a period nanoseconds and may be held back for up
+     * to \a max_latency nanoseconds before being reported, which allows the system
+     * to sleep in between. A \a max_latency of 0 requests continuous delivery.
+     * Sensors without a hardware FIFO only honour the sampling period.
+     *
+     * \returns U_STATUS_SUCCESS if successful or U_STATUS_ERROR if an error occured.
+     * \param[in] sensor The sensor instance to be modified.
+     * \param[in] period The sampling period in nanoseconds.
+     * \param[in] max_latency The maximum report latency in nanoseconds.
+     */
+    UBUNTU_DLL_PUBLIC UStatus
+    ua_sensors_proximity_set_batching(
+        UASensorsProximity* sensor,
+        uint64_t period,
+        uint64_t max_latency);
+
 #ifdef __cplusplus
 }
 #endif
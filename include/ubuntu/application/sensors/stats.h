@@ -0,0 +1,84 @@
+/*
+ * Copyright © 2013 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UBUNTU_APPLICATION_SENSORS_STATS_H_
+#define UBUNTU_APPLICATION_SENSORS_STATS_H_
+
+#include <ubuntu/status.h>
+#include <ubuntu/visibility.h>
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /** Number of buckets in UASensorsStats::latency_histogram. */
+#define U_SENSORS_LATENCY_BUCKETS 16
+
+    /**
+     * \brief Counters describing the readings of a sensor since it has been created.
+     * \ingroup sensor_access
+     *
+     * Latencies are measured from the timestamp of a reading to the moment its
+     * reading callback is invoked, all times are in [ns].
+     */
+    typedef struct
+    {
+        uint64_t received; ///< Readings received from the sensor.
+        uint64_t decimated; ///< Readings not reported because of ua_sensors_set_decimation.
+        uint64_t dropped; ///< Readings lost because the deferred delivery queue was full.
+        uint64_t delivered; ///< Readings handed to the reading callbacks.
+        /** Bucket i counts deliveries with a latency in [2^i, 2^(i+1)) us; the
+         * first bucket also holds shorter, the last one all longer latencies. */
+        uint64_t latency_histogram[U_SENSORS_LATENCY_BUCKETS];
+        uint64_t total_latency; ///< Sum of all delivery latencies.
+        uint64_t max_latency; ///< Longest delivery latency.
+        uint64_t callbacks; ///< Invocations of reading and batch reading callbacks.
+        uint64_t total_callback_time; ///< Time spent in reading and batch reading callbacks.
+        uint64_t max_callback_time; ///< Longest single callback invocation.
+        /* The following counters are shared by all sensors of a process. They
+         * describe the thread that reads from the platform's sensor service
+         * and stay 0 with backends that do not have one. */
+        uint64_t wakeups; ///< Wakeups of the reading thread that found readings.
+        uint64_t wakeup_readings; ///< Readings drained by these wakeups.
+        uint64_t max_wakeup_readings; ///< Most readings drained by a single wakeup.
+        uint64_t pool_high_water; ///< Most preallocated readings seen in use at the same time.
+        uint64_t pool_exhausted; ///< Readings allocated on the heap because all preallocated ones were in use.
+    } UASensorsStats;
+
+    /**
+     * \brief Takes a snapshot of the statistics of a sensor.
+     * \ingroup sensor_access
+     *
+     * The counters are updated with relaxed atomic operations on the delivering
+     * threads, so a snapshot taken while readings arrive may be off by the
+     * readings in flight.
+     *
+     * \returns U_STATUS_SUCCESS if successful or U_STATUS_ERROR if an error occured.
+     * \param[in] sensor Any sensor instance obtained from one of the ua_sensors_*_new functions.
+     * \param[out] stats Receives the statistics.
+     */
+    UBUNTU_DLL_PUBLIC UStatus
+    ua_sensors_get_stats(
+        void* sensor,
+        UASensorsStats* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UBUNTU_APPLICATION_SENSORS_STATS_H_ */
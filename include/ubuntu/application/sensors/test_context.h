@@ -0,0 +1,136 @@
+/*
+ * Copyright © 2013 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UBUNTU_APPLICATION_SENSORS_TEST_CONTEXT_H_
+#define UBUNTU_APPLICATION_SENSORS_TEST_CONTEXT_H_
+
+#include <ubuntu/status.h>
+#include <ubuntu/visibility.h>
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /**
+     * \brief Opaque type that models an independent sensor simulation of the test backend.
+     * \ingroup sensor_access
+     *
+     * Every context replays its own script with its own clock and owns its own
+     * set of sensors, so tests can run side by side in the same process.
+     * Contexts are only available with the test backend, all other backends
+     * fail to create them.
+     */
+    typedef void UASensorsTestContext;
+
+    /**
+     * \brief Selects the clock a context replays its events on.
+     * \ingroup sensor_access
+     */
+    typedef enum
+    {
+        U_SENSORS_TEST_CLOCK_DEFAULT, ///< As configured by UBUNTU_PLATFORM_API_SENSOR_TEST_CLOCK, real if unset.
+        U_SENSORS_TEST_CLOCK_REAL, ///< Events are replayed in real time, scaled by the replay speed.
+        U_SENSORS_TEST_CLOCK_VIRTUAL ///< Events are only released by ua_sensors_test_context_advance_clock.
+    } UASensorsTestClock;
+
+    /**
+     * \brief Creates a new simulation context.
+     * \ingroup sensor_access
+     * \returns A new instance or NULL in case of errors.
+     * \param[in] data_file Script or binary trace to replay, as with
+     * UBUNTU_PLATFORM_API_SENSOR_TEST. If NULL, the context reads commands from
+     * a named pipe of its own, see ua_sensors_test_context_get_fifo_path.
+     */
+    UBUNTU_DLL_PUBLIC UASensorsTestContext*
+    ua_sensors_test_context_new(
+        const char* data_file);
+
+    /**
+     * \brief Creates a new simulation context that replays on the given clock.
+     * \ingroup sensor_access
+     *
+     * Like ua_sensors_test_context_new, which uses U_SENSORS_TEST_CLOCK_DEFAULT.
+     * \returns A new instance or NULL in case of errors.
+     * \param[in] data_file Script or binary trace to replay, or NULL for a named pipe.
+     * \param[in] clock The clock to replay the events on.
+     */
+    UBUNTU_DLL_PUBLIC UASensorsTestContext*
+    ua_sensors_test_context_new_with_clock(
+        const char* data_file,
+        UASensorsTestClock clock);
+
+    /**
+     * \brief Stops the simulation and releases the context.
+     * \ingroup sensor_access
+     *
+     * All sensors obtained from the context become invalid. If the context is
+     * current for any thread, that thread has to bind another one first.
+     * \param[in] context The context to be destroyed.
+     */
+    UBUNTU_DLL_PUBLIC void
+    ua_sensors_test_context_destroy(
+        UASensorsTestContext* context);
+
+    /**
+     * \brief Binds the calling thread to a context.
+     * \ingroup sensor_access
+     *
+     * The ua_sensors_*_new functions called on this thread return the sensors
+     * of the context from now on. Sensor instances stay attached to the context
+     * they have been obtained from and can be used from any thread.
+     * \returns U_STATUS_SUCCESS if successful or U_STATUS_ERROR if an error occured.
+     * \param[in] context The context to bind, or NULL for the process-wide
+     * context configured by the environment.
+     */
+    UBUNTU_DLL_PUBLIC UStatus
+    ua_sensors_test_context_make_current(
+        UASensorsTestContext* context);
+
+    /**
+     * \brief Queries the named pipe a context reads its commands from.
+     * \ingroup sensor_access
+     * \returns The path of the pipe, or NULL if the context replays a data file.
+     * \param[in] context The context to query.
+     */
+    UBUNTU_DLL_PUBLIC const char*
+    ua_sensors_test_context_get_fifo_path(
+        UASensorsTestContext* context);
+
+    /**
+     * \brief Moves the virtual clock of a context on and delivers the events that become due.
+     * \ingroup sensor_access
+     *
+     * Only available if UBUNTU_PLATFORM_API_SENSOR_TEST_CLOCK is set to
+     * virtual. Returns once all events up to the new time have been delivered;
+     * when replaying a data file, that includes the events not parsed yet. Must
+     * not be called from a reading callback.
+     * \returns U_STATUS_SUCCESS if successful or U_STATUS_ERROR if the context has no virtual clock.
+     * \param[in] context The context whose clock to advance, or NULL for the
+     * process-wide context configured by the environment.
+     * \param[in] duration The time to advance by, in [ns].
+     */
+    UBUNTU_DLL_PUBLIC UStatus
+    ua_sensors_test_context_advance_clock(
+        UASensorsTestContext* context,
+        uint64_t duration);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UBUNTU_APPLICATION_SENSORS_TEST_CONTEXT_H_ */
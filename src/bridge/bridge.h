@@ -20,54 +20,376 @@
 #define BASE_BRIDGE_H_
 
 #include <assert.h>
+#include <ctype.h>
 #include <dlfcn.h>
+#include <pthread.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 
 #define MAX_MODULE_NAME 32
+#define MAX_OVERRIDES 16
+#define MAX_ROUTES 16
+#define MAX_MODULES 32
 
 #define HIDDEN_SYMBOL __attribute__ ((visibility ("hidden")))
 
 namespace internal
 {
+/* Entry of a dispatch table: slot receives the address of symbol, resolved
+ * from the backend that implements module. */
+struct HIDDEN_SYMBOL Binding
+{
+    const char* symbol;
+    const char* module;
+    void** slot;
+};
+
 template<typename Scope>
 class HIDDEN_SYMBOL Bridge
 {
   public:
-    static Bridge<Scope>& instance()
+    /* The first call sets up the bridge, libraries are loaded with flags as
+     * passed to dlopen() once a module needs them. Later calls ignore flags,
+     * see resolve_now(). */
+    static Bridge<Scope>& instance(int flags = RTLD_LAZY)
     { 
-        static Bridge<Scope> bridge; 
+        static Bridge<Scope> bridge(flags); 
         return bridge; 
     }
 
-    void* resolve_symbol(const char* symbol, const char* module = "") const
+    /* Time spent looking up library paths and in dlopen() so far, in [ns]. */
+    uint64_t path_time() const
+    {
+        return __atomic_load_n(&path_ns, __ATOMIC_RELAXED);
+    }
+
+    uint64_t load_time() const
+    {
+        return __atomic_load_n(&load_ns, __ATOMIC_RELAXED);
+    }
+
+    static uint64_t monotonic_ns()
+    {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return uint64_t(now.tv_sec) * 1000000000ULL + now.tv_nsec;
+    }
+
+    void* resolve_symbol(const char* symbol, const char* module = "")
     {
-        static const char* test_modules = secure_getenv("UBUNTU_PLATFORM_API_TEST_OVERRIDE");
-        if (test_modules && strstr(test_modules, module)) {
-            printf("Platform API: INFO: Overriding symbol '%s' with test version\n", symbol);
-            return Scope::dlsym_fn(lib_override_handle, symbol);
-        } else {
-            return Scope::dlsym_fn(lib_handle, symbol);
+        pthread_mutex_lock(&lock);
+        void* address = Scope::dlsym_fn(handle_for(module), symbol);
+        pthread_mutex_unlock(&lock);
+        return address;
+    }
+
+    /* Loads the libraries that are still needed with RTLD_NOW instead of
+     * RTLD_LAZY. Returns false if a library has been loaded lazily before,
+     * which stays that way. */
+    bool resolve_now()
+    {
+        pthread_mutex_lock(&lock);
+        flags = (flags & ~RTLD_LAZY) | RTLD_NOW;
+        const bool applied = !loaded_lazily;
+        pthread_mutex_unlock(&lock);
+        return applied;
+    }
+
+    /* True if the symbols of module are taken from the override library. */
+    bool is_overridden(const char* module) const
+    {
+        for (size_t i = 0; i < override_count; i++)
+            if (strcmp(overrides[i], module) == 0)
+                return true;
+
+        return false;
+    }
+
+    /* Stores up to count names of overridden modules, returns the number of
+     * overridden modules. The names stay valid as long as the bridge. */
+    size_t list_overrides(const char** modules, size_t count) const
+    {
+        for (size_t i = 0; i < override_count && i < count; i++)
+            modules[i] = overrides[i];
+
+        return override_count;
+    }
+
+    /* Resolves the entries in [begin, end) that belong to module, or all of
+     * them if module is NULL, unless their module has been bound before.
+     * Reports the symbols the backend lacks; their slots are set to NULL. */
+    void bind(const Binding* begin, const Binding* end, const char* module = NULL)
+    {
+        pthread_mutex_lock(&lock);
+
+        size_t missing = 0, count = 0;
+        for (const Binding* b = begin; b != end; ++b) {
+            if ((module != NULL && strcmp(b->module, module) != 0) || is_bound(b->module))
+                continue;
+
+            void* handle = handle_for(b->module);
+            void* address = Scope::dlsym_fn(handle, b->symbol);
+            __atomic_store_n(b->slot, address, __ATOMIC_RELEASE);
+            if (address == NULL && handle != NULL) {
+                fprintf(stderr, "Platform API: WARNING: Backend does not provide '%s'\n", b->symbol);
+                missing++;
+            }
+            count++;
         }
+
+        for (const Binding* b = begin; b != end; ++b)
+            if (module == NULL || strcmp(b->module, module) == 0)
+                mark_bound(b->module);
+
+        pthread_mutex_unlock(&lock);
+
+        if (missing > 0)
+            fprintf(stderr, "Platform API: WARNING: %zu of %zu symbols are missing\n", missing, count);
     }
 
   protected:
-    Bridge()
-        : lib_handle(Scope::dlopen_fn(Scope::path(), RTLD_LAZY))
+    /* A module that is served by its own library instead of the default one. */
+    struct Route
+    {
+        char module[MAX_MODULE_NAME + 1];
+        char library[MAX_MODULE_NAME + 1];
+        void* handle;
+        bool loaded;
+    };
+
+    Bridge(int flags)
+        : flags(flags),
+          loaded_lazily(false),
+          lib_handle(NULL),
+          lib_loaded(false),
+          lib_override_handle(NULL),
+          override_count(0),
+          route_count(0),
+          bound_count(0),
+          path_ns(0),
+          load_ns(0)
     {
-        if (Scope::override_path() && secure_getenv("UBUNTU_PLATFORM_API_TEST_OVERRIDE"))
-            lib_override_handle = (Scope::dlopen_fn(Scope::override_path(), RTLD_LAZY));
+        pthread_mutex_init(&lock, NULL);
+
+        const char* routes = Scope::routes();
+        if (routes)
+            parse_routes(routes);
+
+        const char* test_modules = secure_getenv("UBUNTU_PLATFORM_API_TEST_OVERRIDE");
+        if (Scope::override_path() && test_modules) {
+            lib_override_handle = load(Scope::override_path());
+            parse_overrides(test_modules);
+        }
     }
 
     ~Bridge()
     {
     }
 
+    /* Returns the library that implements module, loading it on first use.
+     * Must be called with the lock held. */
+    void* handle_for(const char* module)
+    {
+        if (is_overridden(module))
+            return lib_override_handle;
+
+        for (size_t i = 0; i < route_count; i++) {
+            Route& route = routes[i];
+            if (strcmp(route.module, module) != 0)
+                continue;
+
+            // A route that names a missing backend, e.g. by a typo, must not
+            // end up elsewhere than where the module would be served without it
+            if (!route.loaded) {
+                const uint64_t start = monotonic_ns();
+                const char* path = Scope::module_path(route.library);
+                __atomic_add_fetch(&path_ns, monotonic_ns() - start, __ATOMIC_RELAXED);
+
+                // scopes without a path for the module cannot serve routes
+                if (path == NULL)
+                    fprintf(stderr, "Platform API: WARNING: Routes are not supported, serving module '%s' from the default backend\n",
+                            route.module);
+                else if ((route.handle = load(path, Scope::dlopen_route_fn)) == NULL)
+                    fprintf(stderr, "Platform API: WARNING: Unable to load backend '%s' for module '%s', using the default backend\n",
+                            route.library, route.module);
+                route.loaded = true;
+            }
+            return route.handle ? route.handle : default_handle();
+        }
+
+        return default_handle();
+    }
+
+    /* Returns the library of the backend selected by Scope::path(), loading
+     * it on first use. Must be called with the lock held. */
+    void* default_handle()
+    {
+        if (!lib_loaded) {
+            const uint64_t start = monotonic_ns();
+            const char* path = Scope::path();
+            __atomic_add_fetch(&path_ns, monotonic_ns() - start, __ATOMIC_RELAXED);
+
+            lib_handle = load(path);
+            lib_loaded = true;
+        }
+        return lib_handle;
+    }
+
+    void* load(const char* path, void* (*dlopen_fn)(const char*, int) = Scope::dlopen_fn)
+    {
+        const uint64_t start = monotonic_ns();
+        void* handle = dlopen_fn(path, flags);
+        __atomic_add_fetch(&load_ns, monotonic_ns() - start, __ATOMIC_RELAXED);
+        if (handle != NULL && (flags & RTLD_NOW) == 0)
+            loaded_lazily = true;
+        return handle;
+    }
+
+    bool is_bound(const char* module) const
+    {
+        for (size_t i = 0; i < bound_count; i++)
+            if (bound[i] == module || strcmp(bound[i], module) == 0)
+                return true;
+
+        return false;
+    }
+
+    // Modules are named by string literals in the dispatch table, which
+    // outlive the bridge
+    void mark_bound(const char* module)
+    {
+        if (!is_bound(module) && bound_count < MAX_MODULES)
+            bound[bound_count++] = module;
+    }
+
+    /* Splits the list of module names at any character that cannot be part
+     * of a name, e.g. "sensors,location" or "sensors location". */
+    void parse_overrides(const char* test_modules)
+    {
+        const char* p = test_modules;
+        while (*p != '\0' && override_count < MAX_OVERRIDES) {
+            size_t length = name_length(p);
+
+            if (length > 0 && length <= MAX_MODULE_NAME) {
+                memcpy(overrides[override_count], p, length);
+                overrides[override_count][length] = '\0';
+                printf("Platform API: INFO: Overriding module '%s' with test version\n", overrides[override_count]);
+                override_count++;
+            }
+
+            p += length > 0 ? length : 1;
+        }
+    }
+
+    /* Reads "module=backend" pairs separated by whitespace or commas, e.g.
+     * "sensors=touch location=test"; '#' starts a comment that runs to the end
+     * of the line. The first route given for a module wins. */
+    void parse_routes(const char* spec)
+    {
+        const char* p = spec;
+        while (*p != '\0' && route_count < MAX_ROUTES) {
+            if (*p == '#') {
+                while (*p != '\0' && *p != '\n')
+                    p++;
+                continue;
+            }
+
+            const char* module = p;
+            const size_t module_length = name_length(module);
+            if (module_length == 0) {
+                p++;
+                continue;
+            }
+
+            p = skip_blanks(module + module_length);
+            if (*p != '=')
+                continue;
+
+            const char* library = skip_blanks(p + 1);
+            const size_t library_length = name_length(library);
+            p = library + library_length;
+
+            if (module_length > MAX_MODULE_NAME || library_length == 0 || library_length > MAX_MODULE_NAME)
+                continue;
+
+            Route& route = routes[route_count];
+            memcpy(route.module, module, module_length);
+            route.module[module_length] = '\0';
+            memcpy(route.library, library, library_length);
+            route.library[library_length] = '\0';
+            route.handle = NULL;
+            route.loaded = false;
+
+            if (has_route(route.module))
+                continue;
+
+            printf("Platform API: INFO: Routing module '%s' to backend '%s'\n", route.module, route.library);
+            route_count++;
+        }
+    }
+
+    static size_t name_length(const char* p)
+    {
+        size_t length = 0;
+        while (isalnum(p[length]) || p[length] == '_')
+            length++;
+
+        return length;
+    }
+
+    static const char* skip_blanks(const char* p)
+    {
+        while (*p == ' ' || *p == '\t')
+            p++;
+
+        return p;
+    }
+
+    bool has_route(const char* module) const
+    {
+        for (size_t i = 0; i < route_count; i++)
+            if (strcmp(routes[i].module, module) == 0)
+                return true;
+
+        return false;
+    }
+
+    int flags;
+    bool loaded_lazily;
+    pthread_mutex_t lock;
     void* lib_handle;
+    bool lib_loaded;
     void* lib_override_handle;
+    char overrides[MAX_OVERRIDES][MAX_MODULE_NAME + 1];
+    size_t override_count;
+    Route routes[MAX_ROUTES];
+    size_t route_count;
+    const char* bound[MAX_MODULES];
+    size_t bound_count;
+    uint64_t path_ns;
+    uint64_t load_ns;
 };
+
+/* Returns the address of symbol, resolving it into *slot on first use.
+ *
+ * Threads that race for the first call all resolve the same address, so any
+ * of their release stores may win. Once bound, the fast path is a single
+ * relaxed load: calling through the pointer depends on the loaded value, which
+ * orders it after the store like a consume load would. */
+template<typename Scope, typename Function>
+inline Function bind_symbol(Function* slot, const char* symbol, const char* module = "")
+{
+    Function f = __atomic_load_n(slot, __ATOMIC_RELAXED);
+    if (__builtin_expect(f == NULL, 0)) {
+        f = reinterpret_cast<Function>(Bridge<Scope>::instance().resolve_symbol(symbol, module));
+        __atomic_store_n(slot, f, __ATOMIC_RELEASE);
+    }
+    return f;
+}
 }
 
 #endif // BRIDGE_H_
@@ -29,105 +29,151 @@ extern "C" {
 /*********** Implementation starts here *******************/
 /**********************************************************/
 
-// this allows DLSYM to return NULL (happens if the backend is not available),
+/* Every wrapper owns one slot of a dispatch table that the linker lays out
+ * contiguously in the section ubuntu_platform_api_vtable, next to a table of
+ * bindings that tell which symbol goes into which slot. All slots start out
+ * pointing to a stub that binds all slots of its module through BIND_TABLE
+ * and then forwards the call, so after the first call into a module every
+ * wrapper of that module is a single indirect call. Binding a module loads
+ * only the backend that serves it. */
+// the explicit alignment keeps the compiler from padding the entries
+#define BRIDGE_VTABLE __attribute__ ((section ("ubuntu_platform_api_vtable"), aligned (sizeof(void*))))
+#define BRIDGE_BINDINGS __attribute__ ((section ("ubuntu_platform_api_bindings"), used, aligned (sizeof(void*))))
+
+extern const internal::Binding __start_ubuntu_platform_api_bindings[] HIDDEN_SYMBOL;
+extern const internal::Binding __stop_ubuntu_platform_api_bindings[] HIDDEN_SYMBOL;
+
+// binds the slots of module; the bridge skips modules that are already bound
+static inline void bridge_bind_module(const char* module)
+{
+    BIND_TABLE(__start_ubuntu_platform_api_bindings,
+               __stop_ubuntu_platform_api_bindings, module);
+}
+
+static inline void bridge_bind_table()
+{
+    static const bool bound = (BIND_TABLE(__start_ubuntu_platform_api_bindings,
+                                          __stop_ubuntu_platform_api_bindings, NULL), true);
+    (void) bound;
+}
+
+// Slots are stored once with release semantics while binding. Calling through
+// the loaded pointer depends on its value, so a relaxed load is sufficient.
+#define BRIDGE_SLOT(symbol) __atomic_load_n(&symbol##_slot, __ATOMIC_RELAXED)
+
+// declares the slot of symbol, typed after the parameter list params, and
+// its binding stub; args forwards the parameters
+#define IMPLEMENT_SLOT(module, return_type, symbol, params, args)                \
+    static return_type symbol##_bind params;                                    \
+    static return_type (*symbol##_slot) params BRIDGE_VTABLE = symbol##_bind;   \
+    static const internal::Binding symbol##_binding BRIDGE_BINDINGS =           \
+        { #symbol, #module, (void**) &symbol##_slot };                          \
+    static return_type symbol##_bind params                                     \
+    {                                                                           \
+        bridge_bind_module(#module);                                            \
+        return BRIDGE_SLOT(symbol) args;                                        \
+    }
+
+// like IMPLEMENT_SLOT, but the binding stub returns null_value instead of
+// calling through the slot if binding left it NULL
+#define IMPLEMENT_OPTIONAL_SLOT(module, return_type, symbol, params, args, null_value) \
+    static return_type symbol##_bind params;                                    \
+    static return_type (*symbol##_slot) params BRIDGE_VTABLE = symbol##_bind;   \
+    static const internal::Binding symbol##_binding BRIDGE_BINDINGS =           \
+        { #symbol, #module, (void**) &symbol##_slot };                          \
+    static return_type symbol##_bind params                                     \
+    {                                                                           \
+        bridge_bind_module(#module);                                            \
+        return_type (*f) params = BRIDGE_SLOT(symbol);                          \
+        return f ? f args : null_value;                                         \
+    }
+
+// this allows the slot to be NULL (happens if the backend is not available),
 // and returns NULL in that case; return_type must be a pointer!
 #define IMPLEMENT_CTOR0(module, return_type, symbol)  \
+    IMPLEMENT_OPTIONAL_SLOT(module, return_type, symbol, (), (), NULL) \
     return_type symbol()                          \
     {                                             \
-        static return_type (*f)() = NULL;         \
-        DLSYM(&f, #symbol, #module);              \
+        return_type (*f)() = BRIDGE_SLOT(symbol);  \
         return f ? f() : NULL;}
 
 #define IMPLEMENT_FUNCTION0(module, return_type, symbol)  \
+    IMPLEMENT_SLOT(module, return_type, symbol, (), ()) \
     return_type symbol()                          \
     {                                             \
-        static return_type (*f)() = NULL;         \
-        DLSYM(&f, #symbol, #module);              \
-        return f();}
+        return BRIDGE_SLOT(symbol)();}
 
 #define IMPLEMENT_VOID_FUNCTION0(module, symbol)  \
+    IMPLEMENT_SLOT(module, void, symbol, (), ())  \
     void symbol()                                 \
     {                                             \
-        static void (*f)() = NULL;                \
-        DLSYM(&f, #symbol, #module);              \
-        f();}
+        BRIDGE_SLOT(symbol)();}
 
 #define IMPLEMENT_FUNCTION1(module, return_type, symbol, arg1) \
+    IMPLEMENT_SLOT(module, return_type, symbol, (arg1 _1), (_1)) \
     return_type symbol(arg1 _1)                        \
     {                                                  \
-        static return_type (*f)(arg1) = NULL;          \
-        DLSYM(&f, #symbol, #module);            \
-        return f(_1); }
+        return BRIDGE_SLOT(symbol)(_1); }
 
 #define IMPLEMENT_VOID_FUNCTION1(module, symbol, arg1)               \
+    IMPLEMENT_SLOT(module, void, symbol, (arg1 _1), (_1))    \
     void symbol(arg1 _1)                                     \
     {                                                        \
-        static void (*f)(arg1) = NULL;                       \
-        DLSYM(&f, #symbol, #module);                  \
-        f(_1); }
+        BRIDGE_SLOT(symbol)(_1); }
 
 #define IMPLEMENT_FUNCTION2(module, return_type, symbol, arg1, arg2)    \
+    IMPLEMENT_SLOT(module, return_type, symbol, (arg1 _1, arg2 _2), (_1, _2)) \
     return_type symbol(arg1 _1, arg2 _2)                        \
     {                                                           \
-        static return_type (*f)(arg1, arg2) = NULL;             \
-        DLSYM(&f, #symbol, #module);                     \
-        return f(_1, _2); }
+        return BRIDGE_SLOT(symbol)(_1, _2); }
 
 #define IMPLEMENT_VOID_FUNCTION2(module, symbol, arg1, arg2)            \
+    IMPLEMENT_SLOT(module, void, symbol, (arg1 _1, arg2 _2), (_1, _2)) \
     void symbol(arg1 _1, arg2 _2)                               \
     {                                                           \
-        static void (*f)(arg1, arg2) = NULL;                    \
-        DLSYM(&f, #symbol, #module);                     \
-        f(_1, _2); }
+        BRIDGE_SLOT(symbol)(_1, _2); }
 
 #define IMPLEMENT_FUNCTION3(module, return_type, symbol, arg1, arg2, arg3)    \
+    IMPLEMENT_SLOT(module, return_type, symbol, (arg1 _1, arg2 _2, arg3 _3), (_1, _2, _3)) \
     return_type symbol(arg1 _1, arg2 _2, arg3 _3)                     \
     {                                                                 \
-        static return_type (*f)(arg1, arg2, arg3) = NULL;             \
-        DLSYM(&f, #symbol, #module);                                  \
-        return f(_1, _2, _3); } 
+        return BRIDGE_SLOT(symbol)(_1, _2, _3); }
 
 #define IMPLEMENT_VOID_FUNCTION3(module, symbol, arg1, arg2, arg3)      \
+    IMPLEMENT_SLOT(module, void, symbol, (arg1 _1, arg2 _2, arg3 _3), (_1, _2, _3)) \
     void symbol(arg1 _1, arg2 _2, arg3 _3)                      \
     {                                                           \
-        static void (*f)(arg1, arg2, arg3) = NULL;              \
-        DLSYM(&f, #symbol, #module);                            \
-        f(_1, _2, _3); }
+        BRIDGE_SLOT(symbol)(_1, _2, _3); }
 
 #define IMPLEMENT_VOID_FUNCTION4(module, symbol, arg1, arg2, arg3, arg4) \
+    IMPLEMENT_SLOT(module, void, symbol, (arg1 _1, arg2 _2, arg3 _3, arg4 _4), (_1, _2, _3, _4)) \
     void symbol(arg1 _1, arg2 _2, arg3 _3, arg4 _4)              \
     {                                                            \
-        static void (*f)(arg1, arg2, arg3, arg4) = NULL;         \
-        DLSYM(&f, #symbol, #module);                             \
-        f(_1, _2, _3, _4); }
+        BRIDGE_SLOT(symbol)(_1, _2, _3, _4); }
 
 #define IMPLEMENT_FUNCTION4(module, return_type, symbol, arg1, arg2, arg3, arg4) \
+    IMPLEMENT_SLOT(module, return_type, symbol, (arg1 _1, arg2 _2, arg3 _3, arg4 _4), (_1, _2, _3, _4)) \
     return_type symbol(arg1 _1, arg2 _2, arg3 _3, arg4 _4)               \
     {                                                                    \
-        static return_type (*f)(arg1, arg2, arg3, arg4) = NULL;          \
-        DLSYM(&f, #symbol, #module);                                     \
-        return f(_1, _2, _3, _4); }
+        return BRIDGE_SLOT(symbol)(_1, _2, _3, _4); }
 
 #define IMPLEMENT_FUNCTION6(module, return_type, symbol, arg1, arg2, arg3, arg4, arg5, arg6) \
+    IMPLEMENT_SLOT(module, return_type, symbol, (arg1 _1, arg2 _2, arg3 _3, arg4 _4, arg5 _5, arg6 _6), (_1, _2, _3, _4, _5, _6)) \
     return_type symbol(arg1 _1, arg2 _2, arg3 _3, arg4 _4, arg5 _5, arg6 _6)         \
     {                                                                                \
-        static return_type (*f)(arg1, arg2, arg3, arg4, arg5, arg6) = NULL;          \
-        DLSYM(&f, #symbol, #module);                                                 \
-        return f(_1, _2, _3, _4, _5, _6); }
+        return BRIDGE_SLOT(symbol)(_1, _2, _3, _4, _5, _6); }
 
 #define IMPLEMENT_VOID_FUNCTION7(module, symbol, arg1, arg2, arg3, arg4, arg5, arg6, arg7) \
+    IMPLEMENT_SLOT(module, void, symbol, (arg1 _1, arg2 _2, arg3 _3, arg4 _4, arg5 _5, arg6 _6, arg7 _7), (_1, _2, _3, _4, _5, _6, _7)) \
     void symbol(arg1 _1, arg2 _2, arg3 _3, arg4 _4, arg5 _5, arg6 _6, arg7 _7) \
     {                                                                   \
-        static void (*f)(arg1, arg2, arg3, arg4, arg5, arg6, arg7) = NULL; \
-        DLSYM(&f, #symbol, #module);                                    \
-        f(_1, _2, _3, _4, _5, _6, _7); }
+        BRIDGE_SLOT(symbol)(_1, _2, _3, _4, _5, _6, _7); }
 
 #define IMPLEMENT_VOID_FUNCTION8(module, symbol, arg1, arg2, arg3, arg4, arg5, arg6, arg7, arg8) \
+    IMPLEMENT_SLOT(module, void, symbol, (arg1 _1, arg2 _2, arg3 _3, arg4 _4, arg5 _5, arg6 _6, arg7 _7, arg8 _8), (_1, _2, _3, _4, _5, _6, _7, _8)) \
     void symbol(arg1 _1, arg2 _2, arg3 _3, arg4 _4, arg5 _5, arg6 _6, arg7 _7, arg8 _8) \
     {                                                                   \
-        static void (*f)(arg1, arg2, arg3, arg4, arg5, arg6, arg7, arg8) = NULL; \
-        DLSYM(&f, #symbol, #module);                                    \
-        f(_1, _2, _3, _4, _5, _6, _7, _8); }
+        BRIDGE_SLOT(symbol)(_1, _2, _3, _4, _5, _6, _7, _8); }
 
 #ifdef __cplusplus
 }
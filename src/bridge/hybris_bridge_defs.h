@@ -29,141 +29,142 @@ extern "C" {
 /*********** Implementation starts here *******************/
 /**********************************************************/
 
+// DLSYM binds the static f once and returns its value, see internal::bind_symbol;
 // this allows DLSYM to return NULL (happens if the backend is not available),
 // and returns NULL in that case; return_type must be a pointer!
 #define IMPLEMENT_CTOR0(return_type, symbol)  \
     return_type symbol()                          \
     {                                             \
         static return_type (*f)() = NULL;         \
-        DLSYM(&f, #symbol);                       \
-        return f ? f() : NULL;}
+        auto bound = DLSYM(&f, #symbol);          \
+        return bound ? bound() : NULL;}
 
 #define IMPLEMENT_FUNCTION0(return_type, symbol)  \
     return_type symbol()                          \
     {                                             \
         static return_type (*f)() = NULL;         \
-        DLSYM(&f, #symbol);                       \
-        return f();}
+        auto bound = DLSYM(&f, #symbol);          \
+        return bound();}
 
 
 #define IMPLEMENT_OPTIONAL_FUNCTION0(return_type, symbol, return_value)  \
     return_type symbol()                          \
     {                                             \
         static return_type (*f)() = NULL;         \
-        DLSYM(&f, #symbol);                       \
-        return f ? f() : return_value;}
+        auto bound = DLSYM(&f, #symbol);          \
+        return bound ? bound() : return_value;}
 
 #define IMPLEMENT_VOID_FUNCTION0(symbol)          \
     void symbol()                                 \
     {                                             \
         static void (*f)() = NULL;                \
-        DLSYM(&f, #symbol);                       \
-        f();}
+        auto bound = DLSYM(&f, #symbol);          \
+        bound();}
 
 #define IMPLEMENT_OPTIONAL_VOID_FUNCTION0(symbol) \
     void symbol()                                 \
     {                                             \
         static void (*f)() = NULL;                \
-        DLSYM(&f, #symbol);                       \
-        if (f) f();}
+        auto bound = DLSYM(&f, #symbol);          \
+        if (bound) bound();}
 
 #define IMPLEMENT_FUNCTION1(return_type, symbol, arg1) \
     return_type symbol(arg1 _1)                        \
     {                                                  \
         static return_type (*f)(arg1) = NULL;          \
-        DLSYM(&f, #symbol);                            \
-        return f(_1); }
+        auto bound = DLSYM(&f, #symbol);               \
+        return bound(_1); }
 
 #define IMPLEMENT_OPTIONAL_FUNCTION1(return_type, symbol, return_value, arg1) \
     return_type symbol(arg1 _1)                                               \
     {                                                                         \
         static return_type (*f)(arg1) = NULL;                                 \
-        DLSYM(&f, #symbol);                                                   \
-        return f ? f(_1) : return_value; }
+        auto bound = DLSYM(&f, #symbol);                                      \
+        return bound ? bound(_1) : return_value; }
 
 #define IMPLEMENT_VOID_FUNCTION1(symbol, arg1)               \
     void symbol(arg1 _1)                                     \
     {                                                        \
         static void (*f)(arg1) = NULL;                       \
-        DLSYM(&f, #symbol);                                  \
-        f(_1); }
+        auto bound = DLSYM(&f, #symbol);                     \
+        bound(_1); }
 
 #define IMPLEMENT_OPTIONAL_VOID_FUNCTION1(symbol, arg1)               \
     void symbol(arg1 _1)                                              \
     {                                                                 \
         static void (*f)(arg1) = NULL;                                \
-        DLSYM(&f, #symbol);                                           \
-        if (f) f(_1); }
+        auto bound = DLSYM(&f, #symbol);                              \
+        if (bound) bound(_1); }
 
 #define IMPLEMENT_FUNCTION2(return_type, symbol, arg1, arg2)    \
     return_type symbol(arg1 _1, arg2 _2)                        \
     {                                                           \
         static return_type (*f)(arg1, arg2) = NULL;             \
-        DLSYM(&f, #symbol);                              \
-        return f(_1, _2); }
+        auto bound = DLSYM(&f, #symbol);                 \
+        return bound(_1, _2); }
 
 #define IMPLEMENT_VOID_FUNCTION2(symbol, arg1, arg2)            \
     void symbol(arg1 _1, arg2 _2)                               \
     {                                                           \
         static void (*f)(arg1, arg2) = NULL;                    \
-        DLSYM(&f, #symbol);                              \
-        f(_1, _2); }
+        auto bound = DLSYM(&f, #symbol);                 \
+        bound(_1, _2); }
 
 #define IMPLEMENT_OPTIONAL_VOID_FUNCTION2(symbol, arg1, arg2)   \
     void symbol(arg1 _1, arg2 _2)                               \
     {                                                           \
         static void (*f)(arg1, arg2) = NULL;                    \
-        DLSYM(&f, #symbol);                                     \
-        if (f) f(_1, _2); }
+        auto bound = DLSYM(&f, #symbol);                        \
+        if (bound) bound(_1, _2); }
 
 #define IMPLEMENT_FUNCTION3(return_type, symbol, arg1, arg2, arg3)    \
     return_type symbol(arg1 _1, arg2 _2, arg3 _3)                     \
     {                                                                 \
         static return_type (*f)(arg1, arg2, arg3) = NULL;             \
-        DLSYM(&f, #symbol);                                           \
-        return f(_1, _2, _3); } 
+        auto bound = DLSYM(&f, #symbol);                              \
+        return bound(_1, _2, _3); } 
 
 #define IMPLEMENT_VOID_FUNCTION3(symbol, arg1, arg2, arg3)      \
     void symbol(arg1 _1, arg2 _2, arg3 _3)                      \
     {                                                           \
         static void (*f)(arg1, arg2, arg3) = NULL;              \
-        DLSYM(&f, #symbol);                                     \
-        f(_1, _2, _3); }
+        auto bound = DLSYM(&f, #symbol);                        \
+        bound(_1, _2, _3); }
 
 #define IMPLEMENT_VOID_FUNCTION4(symbol, arg1, arg2, arg3, arg4) \
     void symbol(arg1 _1, arg2 _2, arg3 _3, arg4 _4)              \
     {                                                            \
         static void (*f)(arg1, arg2, arg3, arg4) = NULL;         \
-        DLSYM(&f, #symbol);                                      \
-        f(_1, _2, _3, _4); }
+        auto bound = DLSYM(&f, #symbol);                         \
+        bound(_1, _2, _3, _4); }
 
 #define IMPLEMENT_FUNCTION4(return_type, symbol, arg1, arg2, arg3, arg4) \
     return_type symbol(arg1 _1, arg2 _2, arg3 _3, arg4 _4)               \
     {                                                                    \
         static return_type (*f)(arg1, arg2, arg3, arg4) = NULL;          \
-        DLSYM(&f, #symbol);                                              \
-        return f(_1, _2, _3, _4); }
+        auto bound = DLSYM(&f, #symbol);                                 \
+        return bound(_1, _2, _3, _4); }
 
 #define IMPLEMENT_FUNCTION6(return_type, symbol, arg1, arg2, arg3, arg4, arg5, arg6) \
     return_type symbol(arg1 _1, arg2 _2, arg3 _3, arg4 _4, arg5 _5, arg6 _6)         \
     {                                                                                \
         static return_type (*f)(arg1, arg2, arg3, arg4, arg5, arg6) = NULL;          \
-        DLSYM(&f, #symbol);                                                          \
-        return f(_1, _2, _3, _4, _5, _6); }
+        auto bound = DLSYM(&f, #symbol);                                             \
+        return bound(_1, _2, _3, _4, _5, _6); }
 
 #define IMPLEMENT_VOID_FUNCTION7(symbol, arg1, arg2, arg3, arg4, arg5, arg6, arg7) \
     void symbol(arg1 _1, arg2 _2, arg3 _3, arg4 _4, arg5 _5, arg6 _6, arg7 _7) \
     {                                                                   \
         static void (*f)(arg1, arg2, arg3, arg4, arg5, arg6, arg7) = NULL; \
-        DLSYM(&f, #symbol);                                             \
-        f(_1, _2, _3, _4, _5, _6, _7); }
+        auto bound = DLSYM(&f, #symbol);                                \
+        bound(_1, _2, _3, _4, _5, _6, _7); }
 
 #define IMPLEMENT_VOID_FUNCTION8(symbol, arg1, arg2, arg3, arg4, arg5, arg6, arg7, arg8) \
     void symbol(arg1 _1, arg2 _2, arg3 _3, arg4 _4, arg5 _5, arg6 _6, arg7 _7, arg8 _8) \
     {                                                                   \
         static void (*f)(arg1, arg2, arg3, arg4, arg5, arg6, arg7, arg8) = NULL; \
-        DLSYM(&f, #symbol);                                             \
-        f(_1, _2, _3, _4, _5, _6, _7, _8); }
+        auto bound = DLSYM(&f, #symbol);                                \
+        bound(_1, _2, _3, _4, _5, _6, _7, _8); }
 
 #ifdef __cplusplus
 }
@@ -82,6 +82,41 @@ struct HIDDEN_SYMBOL ToBackend
         return path;
     }
     
+    /* Modules can be served by other backends than the one selected above,
+     * e.g. "sensors=touch location=test" loads libubuntu_application_api_touch
+     * for sensors only. The routes are read from $UBUNTU_PLATFORM_API_BACKEND_ROUTES
+     * or /etc/ubuntu-platform-api/routes.conf, one "module=backend" pair per line.
+     */
+    static const char* routes()
+    {
+        const char* env = secure_getenv("UBUNTU_PLATFORM_API_BACKEND_ROUTES");
+        if (env != NULL)
+            return env;
+
+        static char conf_routes[1024];
+        FILE* conf = fopen("/etc/ubuntu-platform-api/routes.conf", "r");
+        if (conf == NULL)
+            return NULL;
+
+        size_t length = fread(conf_routes, 1, sizeof(conf_routes) - 1, conf);
+        conf_routes[length] = '\0';
+        fclose(conf);
+
+        return conf_routes;
+    }
+
+    static const char* module_path(const char* module)
+    {
+        static char path[128];
+
+        strcpy(path, "libubuntu_application_api_");
+        strcat(path, module);
+        strcat(path, SO_SUFFIX);
+
+        fprintf(stderr, "Loading module: '%s'\n", path);
+        return path;
+    }
+
     static const char* override_path()
     {
         // Hardcoded for the testbackend
@@ -120,6 +155,17 @@ struct HIDDEN_SYMBOL ToBackend
         return handle;
     }
 
+    // routed backends are optional: no fallback to the test backend, the
+    // bridge serves their modules from the default backend instead
+    static void* dlopen_route_fn(const char* path, int flags)
+    {
+        void* handle = dlopen(path, flags);
+        if (handle == NULL)
+            fprintf(stderr, "Unable to load routed module: %s\n", dlerror());
+
+        return handle;
+    }
+
     static void* dlsym_fn(void* handle, const char* symbol)
     {
         if (not handle)
@@ -129,7 +175,7 @@ struct HIDDEN_SYMBOL ToBackend
 };
 }
 
-#define DLSYM(fptr, sym, module) if (*(fptr) == NULL) { *((void**)fptr) = (void *) internal::Bridge<internal::ToBackend>::instance().resolve_symbol(sym, module); }
+#define BIND_TABLE(begin, end, module) internal::Bridge<internal::ToBackend>::instance().bind(begin, end, module)
 
 #include <bridge_defs.h>
 
@@ -20,6 +20,10 @@
 #include <ubuntu/application/sensors/proximity.h>
 #include <ubuntu/application/sensors/light.h>
 #include <ubuntu/application/sensors/orientation.h>
+#include <ubuntu/application/sensors/delivery.h>
+#include <ubuntu/application/sensors/decimation.h>
+#include <ubuntu/application/sensors/stats.h>
+#include <ubuntu/application/sensors/test_context.h>
 
 #include <stddef.h>
 
@@ -81,10 +85,19 @@ UStatus ua_sensors_accelerometer_set_event_rate(UASensorsAccelerometer* s, uint3
     return U_STATUS_SUCCESS;
 }
 
+UStatus ua_sensors_accelerometer_set_batching(UASensorsAccelerometer*, uint64_t, uint64_t)
+{
+    return U_STATUS_SUCCESS;
+}
+
 void ua_sensors_accelerometer_set_reading_cb(UASensorsAccelerometer*, on_accelerometer_event_cb, void*)
 {
 }
 
+void ua_sensors_accelerometer_set_batch_reading_cb(UASensorsAccelerometer*, on_accelerometer_batch_cb, void*)
+{
+}
+
 // Acceleration Sensor Event
 uint64_t uas_accelerometer_event_get_timestamp(UASAccelerometerEvent*)
 {
@@ -177,6 +190,11 @@ UStatus ua_sensors_proximity_set_event_rate(UASensorsProximity* s, uint32_t rate
     return U_STATUS_SUCCESS;
 }
 
+UStatus ua_sensors_proximity_set_batching(UASensorsProximity*, uint64_t, uint64_t)
+{
+    return U_STATUS_SUCCESS;
+}
+
 void ua_sensors_proximity_set_reading_cb(UASensorsProximity*, on_proximity_event_cb, void*)
 {
 }
@@ -249,6 +267,11 @@ UStatus ua_sensors_light_set_event_rate(UASensorsLight* s, uint32_t rate)
     return U_STATUS_SUCCESS;
 }
 
+UStatus ua_sensors_light_set_batching(UASensorsLight*, uint64_t, uint64_t)
+{
+    return U_STATUS_SUCCESS;
+}
+
 void ua_sensors_light_set_reading_cb(UASensorsLight*, on_light_event_cb, void*)
 {
 }
@@ -325,10 +348,19 @@ UStatus ua_sensors_orientation_set_event_rate(UASensorsOrientation* s, uint32_t
     return U_STATUS_SUCCESS;
 }
 
+UStatus ua_sensors_orientation_set_batching(UASensorsOrientation*, uint64_t, uint64_t)
+{
+    return U_STATUS_SUCCESS;
+}
+
 void ua_sensors_orientation_set_reading_cb(UASensorsOrientation*, on_orientation_event_cb, void*)
 {
 }
 
+void ua_sensors_orientation_set_batch_reading_cb(UASensorsOrientation*, on_orientation_batch_cb, void*)
+{
+}
+
 // Orientation Sensor Event
 uint64_t uas_orientation_event_get_timestamp(UASOrientationEvent*)
 {
@@ -364,3 +396,66 @@ UStatus uas_orientation_event_get_roll(UASOrientationEvent*, float* value)
 
     return U_STATUS_SUCCESS;
 }
+
+// Deferred delivery
+UStatus ua_sensors_set_delivery_mode(void*, UASensorsDeliveryMode)
+{
+    return U_STATUS_ERROR;
+}
+
+int ua_sensors_get_delivery_fd(void*)
+{
+    return -1;
+}
+
+uint32_t ua_sensors_dispatch_pending(void*)
+{
+    return 0;
+}
+
+uint64_t ua_sensors_get_dropped_readings(void*)
+{
+    return 0;
+}
+
+// Decimation
+UStatus ua_sensors_set_decimation(void*, uint64_t, UASensorsFilter, float)
+{
+    return U_STATUS_ERROR;
+}
+
+// Statistics
+UStatus ua_sensors_get_stats(void*, UASensorsStats*)
+{
+    return U_STATUS_ERROR;
+}
+
+// Simulation contexts
+UASensorsTestContext* ua_sensors_test_context_new(const char*)
+{
+    return NULL;
+}
+
+UASensorsTestContext* ua_sensors_test_context_new_with_clock(const char*, UASensorsTestClock)
+{
+    return NULL;
+}
+
+void ua_sensors_test_context_destroy(UASensorsTestContext*)
+{
+}
+
+UStatus ua_sensors_test_context_make_current(UASensorsTestContext*)
+{
+    return U_STATUS_ERROR;
+}
+
+const char* ua_sensors_test_context_get_fifo_path(UASensorsTestContext*)
+{
+    return NULL;
+}
+
+UStatus ua_sensors_test_context_advance_clock(UASensorsTestContext*, uint64_t)
+{
+    return U_STATUS_ERROR;
+}
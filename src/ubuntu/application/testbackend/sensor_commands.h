@@ -0,0 +1,711 @@
+/*
+ * Copyright (C) 2015 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The text format of the test sensor backend, see README.md. Shared between
+ * the backend and the trace converter. */
+
+#ifndef UBUNTU_APPLICATION_TESTBACKEND_SENSOR_COMMANDS_H_
+#define UBUNTU_APPLICATION_TESTBACKEND_SENSOR_COMMANDS_H_
+
+#include <ubuntu/application/sensors/proximity.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ostream>
+#include <vector>
+
+#include <poll.h>
+#include <unistd.h>
+
+// same numbering as the Android backend's SensorType
+enum ubuntu_sensor_type
+{
+    first_defined_sensor_type = 0,
+    ubuntu_sensor_type_accelerometer = first_defined_sensor_type,
+    ubuntu_sensor_type_magnetic_field,
+    ubuntu_sensor_type_gyroscope,
+    ubuntu_sensor_type_light,
+    ubuntu_sensor_type_proximity,
+    ubuntu_sensor_type_orientation,
+    ubuntu_sensor_type_linear_acceleration,
+    ubuntu_sensor_type_rotation_vector,
+    undefined_sensor_type
+};
+
+
+/* A piece of a command line. Tokens point into the buffer of the LineReader
+ * they came from and are only valid until it reads the next line. */
+struct Token
+{
+    Token() : begin(NULL), size(0) {}
+    Token(const char* _begin, size_t _size) : begin(_begin), size(_size) {}
+
+    bool empty() const { return size == 0; }
+
+    bool operator==(const char* s) const
+    {
+        return strncmp(begin, s, size) == 0 && s[size] == '\0';
+    }
+
+    bool operator!=(const char* s) const { return !(*this == s); }
+
+    const char* begin;
+    size_t size;
+};
+
+inline std::ostream& operator<<(std::ostream& os, const Token& t)
+{
+    return os.write(t.begin, t.size);
+}
+
+/* Splits a command line at blanks and converts numbers in place. */
+class Tokenizer
+{
+  public:
+    explicit Tokenizer(const Token& line) : pos(line.begin), end(line.begin + line.size) {}
+
+    // next blank separated token, empty at the end of the line
+    Token next()
+    {
+        while (pos < end && (*pos == ' ' || *pos == '\t'))
+            ++pos;
+
+        const char* begin = pos;
+        while (pos < end && *pos != ' ' && *pos != '\t')
+            ++pos;
+
+        return Token(begin, pos - begin);
+    }
+
+    bool next_int(int& value)
+    {
+        Token t = next();
+        const char* p = t.begin;
+        const char* e = t.begin + t.size;
+        bool negative = p < e && *p == '-';
+        if (p < e && (*p == '-' || *p == '+'))
+            ++p;
+        if (p == e || e - p > 9)
+            return false;
+
+        int v = 0;
+        for (; p < e; ++p) {
+            if (*p < '0' || *p > '9')
+                return false;
+            v = v * 10 + (*p - '0');
+        }
+
+        value = negative ? -v : v;
+        return true;
+    }
+
+    bool next_float(float& value)
+    {
+        Token t = next();
+        return !t.empty() && (parse_float_fast(t, value) || parse_float_slow(t, value));
+    }
+
+  private:
+    /* Decimal numbers whose significant digits and power of ten are both
+     * exactly representable as float are converted with a single
+     * multiplication or division. Computing it in double and rounding to float
+     * once more still yields the correctly rounded result, as double carries
+     * more than twice the precision of float. */
+    static bool parse_float_fast(const Token& t, float& value)
+    {
+        static const double powers_of_ten[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10
+        };
+
+        const char* p = t.begin;
+        const char* e = t.begin + t.size;
+        bool negative = *p == '-';
+        if (*p == '-' || *p == '+')
+            ++p;
+
+        uint64_t mantissa = 0;
+        int digits = 0, exponent = 0;
+        bool any_digit = false;
+
+        for (; p < e && *p >= '0' && *p <= '9'; ++p, any_digit = true) {
+            if (mantissa == 0 && *p == '0')
+                continue;
+            mantissa = mantissa * 10 + (*p - '0');
+            ++digits;
+        }
+        if (p < e && *p == '.') {
+            for (++p; p < e && *p >= '0' && *p <= '9'; ++p, any_digit = true) {
+                if (mantissa == 0 && *p == '0') {
+                    --exponent;
+                    continue;
+                }
+                mantissa = mantissa * 10 + (*p - '0');
+                ++digits;
+                --exponent;
+            }
+        }
+        if (!any_digit || digits > 19)
+            return false;
+
+        if (p < e && (*p == 'e' || *p == 'E')) {
+            ++p;
+            bool negative_exponent = p < e && *p == '-';
+            if (p < e && (*p == '-' || *p == '+'))
+                ++p;
+            if (p == e)
+                return false;
+
+            int e10 = 0;
+            for (; p < e && *p >= '0' && *p <= '9'; ++p) {
+                if (e10 > 1000)
+                    return false;
+                e10 = e10 * 10 + (*p - '0');
+            }
+            exponent += negative_exponent ? -e10 : e10;
+        }
+        if (p != e)
+            return false;
+
+        // beyond 2^24 respectively 10^10 (5^10 < 2^24) the operands are not
+        // exact floats, and rounding in double first could differ from strtof()
+        if (mantissa > (uint64_t(1) << 24) || exponent < -10 || exponent > 10)
+            return false;
+
+        double v = double(mantissa);
+        v = exponent < 0 ? v / powers_of_ten[-exponent] : v * powers_of_ten[exponent];
+        value = float(negative ? -v : v);
+        return true;
+    }
+
+    // everything else, like inf, nan or hexadecimal notation
+    static bool parse_float_slow(const Token& t, float& value)
+    {
+        char buf[64];
+        if (t.size >= sizeof(buf))
+            return false;
+
+        memcpy(buf, t.begin, t.size);
+        buf[t.size] = '\0';
+
+        char* parsed_end;
+        value = strtof(buf, &parsed_end);
+        return parsed_end == buf + t.size;
+    }
+
+    const char* pos;
+    const char* end;
+};
+
+/* Buffered reader that hands out the lines of a file or pipe in place. Comments
+ * (from # to the end of the line) and surrounding blanks are stripped, lines
+ * that end up empty are skipped. Waiting for input ends as soon as the
+ * optional cancel_fd becomes readable. */
+class LineReader
+{
+  public:
+    static const size_t initial_capacity = 64 * 1024;
+
+    LineReader() : fd(-1), cancel_fd(-1), buffer(initial_capacity), begin(0), end(0), eof(false) {}
+
+    void reset(int _fd, int _cancel_fd = -1)
+    {
+        fd = _fd;
+        cancel_fd = _cancel_fd;
+        begin = end = 0;
+        eof = false;
+    }
+
+    // returns false once the input is exhausted
+    bool next(Token& line)
+    {
+        for (;;) {
+            const char* start = buffer.data() + begin;
+            const char* newline = static_cast<const char*>(memchr(start, '\n', end - begin));
+
+            size_t length;
+            if (newline != NULL) {
+                length = newline - start;
+                begin += length + 1;
+            } else if (!eof) {
+                fill();
+                continue;
+            } else if (begin < end) {
+                // last line without a line break
+                length = end - begin;
+                begin = end;
+            } else {
+                return false;
+            }
+
+            const char* comment = static_cast<const char*>(memchr(start, '#', length));
+            if (comment != NULL)
+                length = comment - start;
+
+            while (length > 0 && (*start == ' ' || *start == '\t')) {
+                ++start;
+                --length;
+            }
+            while (length > 0 && (start[length - 1] == ' ' || start[length - 1] == '\t' || start[length - 1] == '\r'))
+                --length;
+
+            if (length > 0) {
+                line = Token(start, length);
+                return true;
+            }
+        }
+    }
+
+  private:
+    void fill()
+    {
+        // move the incomplete line to the front, grow if it fills the whole buffer
+        if (begin > 0) {
+            memmove(buffer.data(), buffer.data() + begin, end - begin);
+            end -= begin;
+            begin = 0;
+        }
+        if (end == buffer.size())
+            buffer.resize(2 * buffer.size());
+
+        if (cancel_fd >= 0) {
+            struct pollfd fds[2] = { { fd, POLLIN, 0 }, { cancel_fd, POLLIN, 0 } };
+            while (poll(fds, 2, -1) < 0 && errno == EINTR)
+                ;
+            if (fds[1].revents != 0) {
+                eof = true;
+                return;
+            }
+        }
+
+        ssize_t n;
+        do {
+            n = read(fd, buffer.data() + end, buffer.size() - end);
+        } while (n < 0 && errno == EINTR);
+
+        if (n < 0)
+            perror("TestSensor ERROR: Failed to read commands");
+        if (n <= 0)
+            eof = true;
+        else
+            end += n;
+    }
+
+    int fd;
+    int cancel_fd;
+    std::vector<char> buffer;
+    size_t begin, end;
+    bool eof;
+};
+
+// names of the sensor types in commands, indexed by ubuntu_sensor_type
+static const char* const sensor_type_names[undefined_sensor_type] = {
+    "accel",
+    "magnetic",
+    "gyro",
+    "light",
+    "proximity",
+    "orientation",
+    "linear_accel",
+    "rotation_vector",
+};
+
+inline ubuntu_sensor_type sensor_type_from_name(const Token& name)
+{
+    for (int type = first_defined_sensor_type; type < undefined_sensor_type; ++type)
+        if (name == sensor_type_names[type])
+            return ubuntu_sensor_type(type);
+
+    return undefined_sensor_type;
+}
+
+inline const char* sensor_type_name(ubuntu_sensor_type type)
+{
+    if (type < first_defined_sensor_type || type >= undefined_sensor_type)
+        return "ERROR_TYPE";
+
+    return sensor_type_names[type];
+}
+
+// create <type> [<min> <max> <resolution>]
+struct CreateCommand
+{
+    ubuntu_sensor_type type;
+    float min_value, max_value, resolution;
+};
+
+// <delay> <type> <value>...
+struct EventCommand
+{
+    float delay; // [ms]
+    ubuntu_sensor_type type;
+    float x, y, z;
+    UASProximityDistance distance;
+};
+
+inline bool is_create_command(const Token& line)
+{
+    return Tokenizer(line).next() == "create";
+}
+
+// returns NULL on success, or a description of the problem
+inline const char* parse_create_command(const Token& line, CreateCommand& command)
+{
+    Tokenizer tokens(line);
+    if (tokens.next() != "create")
+        return "not a create command";
+
+    command.type = sensor_type_from_name(tokens.next());
+    command.min_value = command.max_value = command.resolution = 0;
+
+    if (command.type == undefined_sensor_type)
+        return "unknown sensor type";
+
+    // proximity sensors have no parameters
+    if (command.type == ubuntu_sensor_type_proximity)
+        return NULL;
+
+    if (!tokens.next_float(command.min_value) || !tokens.next_float(command.max_value)
+        || !tokens.next_float(command.resolution))
+        return "invalid number";
+    if (command.max_value <= command.min_value)
+        return "max_value must be >= min_value";
+    if (command.resolution <= 0)
+        return "resolution must be > 0";
+
+    return NULL;
+}
+
+// checks the values of an event against the constraints of its sensor type;
+// returns NULL on success, or a description of the problem
+inline const char* check_event_values(ubuntu_sensor_type type, float x, float y, float z)
+{
+    // orientation is <azimuth> <pitch> <roll> in degrees
+    if (type == ubuntu_sensor_type_orientation) {
+        if (!(x >= 0 && x < 360))
+            return "azimuth must be in [0, 360)";
+        if (!(y >= -180 && y <= 180))
+            return "pitch must be in [-180, 180]";
+        if (!(z >= -90 && z <= 90))
+            return "roll must be in [-90, 90]";
+    }
+
+    // the rotation vector is the vector part of a unit quaternion
+    if (type == ubuntu_sensor_type_rotation_vector && !(x * x + y * y + z * z <= 1.0001f))
+        return "rotation vector must not be longer than 1";
+
+    return NULL;
+}
+
+// returns NULL on success, or a description of the problem
+inline const char* parse_event_command(const Token& line, EventCommand& command)
+{
+    Tokenizer tokens(line);
+    command.x = command.y = command.z = 0;
+    command.distance = (UASProximityDistance) 0;  // LP#1256969
+
+    if (!tokens.next_float(command.delay) || !(command.delay > 0))
+        return "delay must be positive";
+
+    command.type = sensor_type_from_name(tokens.next());
+
+    switch (command.type) {
+        case ubuntu_sensor_type_light:
+            if (!tokens.next_float(command.x))
+                return "invalid number";
+            break;
+
+        case ubuntu_sensor_type_accelerometer:
+        case ubuntu_sensor_type_magnetic_field:
+        case ubuntu_sensor_type_gyroscope:
+        case ubuntu_sensor_type_orientation:
+        case ubuntu_sensor_type_linear_acceleration:
+        case ubuntu_sensor_type_rotation_vector:
+            if (!tokens.next_float(command.x) || !tokens.next_float(command.y) || !tokens.next_float(command.z))
+                return "invalid number";
+            break;
+
+        case ubuntu_sensor_type_proximity: {
+            Token value = tokens.next();
+            if (value == "unknown")
+                command.distance = (UASProximityDistance) 0;  // LP#1256969
+            else if (value == "near")
+                command.distance = U_PROXIMITY_NEAR;
+            else if (value == "far")
+                command.distance = U_PROXIMITY_FAR;
+            else
+                return "unknown proximity value";
+            break;
+        }
+
+        default:
+            return "unknown sensor type";
+    }
+
+    return check_event_values(command.type, command.x, command.y, command.z);
+}
+
+inline bool is_speed_command(const Token& line)
+{
+    return Tokenizer(line).next() == "speed";
+}
+
+// a positive replay speed factor, or "unthrottled" which yields 0
+inline bool parse_speed(const Token& value, float& speed)
+{
+    if (value == "unthrottled") {
+        speed = 0;
+        return true;
+    }
+
+    Tokenizer tokens(value);
+    return tokens.next_float(speed) && speed > 0 && tokens.next().empty();
+}
+
+// speed <factor>|unthrottled; returns NULL on success, or a description of the problem
+inline const char* parse_speed_command(const Token& line, float& speed)
+{
+    Tokenizer tokens(line);
+    if (tokens.next() != "speed")
+        return "not a speed command";
+    if (!parse_speed(tokens.next(), speed))
+        return "speed must be a positive factor or unthrottled";
+
+    return NULL;
+}
+
+inline bool is_timing_command(const Token& line)
+{
+    return Tokenizer(line).next() == "timing";
+}
+
+// timing global|per-sensor; returns NULL on success, or a description of the problem
+inline const char* parse_timing_command(const Token& line, bool& per_sensor)
+{
+    Tokenizer tokens(line);
+    if (tokens.next() != "timing")
+        return "not a timing command";
+
+    Token mode = tokens.next();
+    if (mode == "global")
+        per_sensor = false;
+    else if (mode == "per-sensor")
+        per_sensor = true;
+    else
+        return "timing must be global or per-sensor";
+
+    return NULL;
+}
+
+inline bool is_advance_command(const Token& line)
+{
+    return Tokenizer(line).next() == "advance";
+}
+
+// advance <duration>; returns NULL on success, or a description of the problem
+inline const char* parse_advance_command(const Token& line, float& duration)
+{
+    Tokenizer tokens(line);
+    if (tokens.next() != "advance")
+        return "not an advance command";
+    if (!tokens.next_float(duration) || !(duration >= 0) || !tokens.next().empty())
+        return "duration must not be negative";
+
+    return NULL;
+}
+
+enum Waveform
+{
+    waveform_sine,
+    waveform_noise,
+    waveform_step,
+    waveform_ramp,
+    waveform_walk
+};
+
+// gen <type> <waveform> <parameters>... <rate> <duration>
+struct GenerateCommand
+{
+    ubuntu_sensor_type type;
+    Waveform waveform;
+    /* sine: frequency [Hz] and amplitude; noise and walk: amplitude;
+     * step and ramp: start and end value */
+    float a, b;
+    float rate; // [Hz]
+    float duration; // [ms]
+};
+
+inline bool is_generate_command(const Token& line)
+{
+    return Tokenizer(line).next() == "gen";
+}
+
+// returns NULL on success, or a description of the problem
+inline const char* parse_generate_command(const Token& line, GenerateCommand& command)
+{
+    Tokenizer tokens(line);
+    if (tokens.next() != "gen")
+        return "not a gen command";
+
+    command.type = sensor_type_from_name(tokens.next());
+    if (command.type == undefined_sensor_type)
+        return "unknown sensor type";
+    if (command.type == ubuntu_sensor_type_proximity)
+        return "proximity sensors cannot be generated";
+
+    Token waveform = tokens.next();
+    if (waveform == "sine")
+        command.waveform = waveform_sine;
+    else if (waveform == "noise")
+        command.waveform = waveform_noise;
+    else if (waveform == "step")
+        command.waveform = waveform_step;
+    else if (waveform == "ramp")
+        command.waveform = waveform_ramp;
+    else if (waveform == "walk")
+        command.waveform = waveform_walk;
+    else
+        return "unknown waveform";
+
+    // noise and walk only take an amplitude
+    const bool two_parameters = command.waveform != waveform_noise && command.waveform != waveform_walk;
+
+    command.b = 0;
+    if (!tokens.next_float(command.a) || (two_parameters && !tokens.next_float(command.b))
+        || !tokens.next_float(command.rate) || !tokens.next_float(command.duration))
+        return "invalid number";
+    if (!tokens.next().empty())
+        return "too many values";
+    if (!(command.rate > 0))
+        return "rate must be positive";
+    if (!(double(command.rate) * command.duration >= 1000))
+        return "duration must cover at least one sample";
+
+    /* Every axis stays within [low, high]. For the constraints of the sensor
+     * types it suffices to check the samples at both ends of that range on
+     * all axes: ranges are checked per axis, and the length of a rotation
+     * vector is largest where all axes are furthest from 0. */
+    float low = 0, high = 0;
+    switch (command.waveform) {
+        case waveform_sine:
+            high = fabs(command.b);
+            low = -high;
+            break;
+        case waveform_noise:
+            high = fabs(command.a);
+            low = -high;
+            break;
+        case waveform_step:
+        case waveform_ramp:
+            low = std::min(command.a, command.b);
+            high = std::max(command.a, command.b);
+            break;
+        case waveform_walk:
+            // the walk moves by up to a step per sample
+            high = float(fabs(command.a) * (double(command.rate) * command.duration / 1000));
+            low = -high;
+            break;
+    }
+
+    const char* error = check_event_values(command.type, low, low, low);
+    if (error == NULL)
+        error = check_event_values(command.type, high, high, high);
+    return error;
+}
+
+/* Evaluates a gen command sample by sample, without keeping any of them.
+ * The same waveform is applied to all three axes, with independent noise.
+ * Random numbers come from a seeded xorshift generator, so that a data file
+ * always generates the same values. */
+class Generator
+{
+  public:
+    Generator(const GenerateCommand& command, uint64_t seed)
+        : command(command),
+          count(uint64_t(double(command.rate) * command.duration / 1000 + 1e-6)),
+          index(0),
+          state(0x9E3779B97F4A7C15ULL * (seed + 1))
+    {
+        walk[0] = walk[1] = walk[2] = 0;
+    }
+
+    // time of the last sample relative to the start of the command [ns]
+    uint64_t duration() const
+    {
+        return offset(count);
+    }
+
+    // computes the next sample, returns false once all have been generated
+    bool next(uint64_t& time, float values[3])
+    {
+        if (index == count)
+            return false;
+
+        time = offset(++index);
+        const double t = time * 1e-9;
+
+        for (int i = 0; i < 3; ++i) {
+            switch (command.waveform) {
+                case waveform_sine:
+                    values[i] = command.b * float(sin(2 * M_PI * command.a * t));
+                    break;
+                case waveform_noise:
+                    values[i] = command.a * uniform();
+                    break;
+                case waveform_step:
+                    values[i] = 2 * index > count ? command.b : command.a;
+                    break;
+                case waveform_ramp:
+                    values[i] = command.a + (command.b - command.a) * float(index) / float(count);
+                    break;
+                case waveform_walk:
+                    walk[i] += command.a * uniform();
+                    values[i] = walk[i];
+                    break;
+            }
+        }
+
+        return true;
+    }
+
+  private:
+    // sample times are computed from the start, so that they do not drift
+    uint64_t offset(uint64_t sample) const
+    {
+        return uint64_t(double(sample) * 1e9 / command.rate + 0.5);
+    }
+
+    // uniformly distributed in [-1, 1)
+    float uniform()
+    {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return float((state * 2685821657736338717ULL) >> 40) / float(1 << 23) - 1.f;
+    }
+
+    GenerateCommand command;
+    uint64_t count;
+    uint64_t index;
+    uint64_t state;
+    float walk[3];
+};
+
+#endif // UBUNTU_APPLICATION_TESTBACKEND_SENSOR_COMMANDS_H_
@@ -0,0 +1,220 @@
+/*
+ * Copyright (C) 2015 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Converts a test sensor data file from the text format into a binary trace
+// that the test backend plays back without parsing, see README.md.
+
+#include <private/application/sensors/sensor_trace.h>
+
+#include "sensor_commands.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+namespace trace = ubuntu::application::sensors::trace;
+
+namespace
+{
+int fail(const char* message, const Token& line)
+{
+    cerr << "ERROR: " << message << " in " << line << endl;
+    return EXIT_FAILURE;
+}
+
+bool earlier(const trace::Record& a, const trace::Record& b)
+{
+    return a.time < b.time;
+}
+
+// records with per-sensor timing arrive out of order, sort them before writing
+bool write_records(vector<trace::Record>& records, FILE* out)
+{
+    stable_sort(records.begin(), records.end(), earlier);
+    bool ok = fwrite(records.data(), sizeof(trace::Record), records.size(), out) == records.size();
+    records.clear();
+    return ok;
+}
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 3) {
+        cerr << "Usage: " << argv[0] << " <text data file> <binary trace>" << endl;
+        return EXIT_FAILURE;
+    }
+
+    int in = open(argv[1], O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        perror(argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    FILE* out = fopen(argv[2], "wb");
+    if (out == NULL) {
+        perror(argv[2]);
+        return EXIT_FAILURE;
+    }
+
+    // every type can be created at most once, so reserve room for all of
+    // them and stream the records right behind the table
+    trace::Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, trace::magic, sizeof(header.magic));
+    header.version = trace::version;
+    header.byte_order = trace::byte_order_mark;
+    header.record_size = sizeof(trace::Record);
+    header.records_offset = trace::records_offset(undefined_sensor_type);
+
+    trace::Sensor sensors[undefined_sensor_type];
+    bool created[undefined_sensor_type] = { false };
+
+    if (fseek(out, header.records_offset, SEEK_SET) < 0) {
+        perror(argv[2]);
+        return EXIT_FAILURE;
+    }
+
+    LineReader reader;
+    reader.reset(in);
+
+    Token line;
+    uint64_t time = 0;
+    bool per_sensor_timing = false;
+    uint64_t stream_time[undefined_sensor_type];
+    vector<trace::Record> pending;
+    uint64_t generator_count = 0;
+    while (reader.next(line)) {
+        if (is_create_command(line)) {
+            CreateCommand command;
+            const char* error = parse_create_command(line, command);
+            if (error != NULL)
+                return fail(error, line);
+            if (created[command.type])
+                return fail("duplicate creation of sensor type", line);
+
+            trace::Sensor& sensor = sensors[header.sensor_count++];
+            sensor.type = command.type;
+            sensor.min_value = command.min_value;
+            sensor.max_value = command.max_value;
+            sensor.resolution = command.resolution;
+            created[command.type] = true;
+            continue;
+        }
+
+        // the replay speed and clock are chosen at playback time
+        if (is_speed_command(line) || is_advance_command(line)) {
+            cerr << "WARNING: ignoring " << line << endl;
+            continue;
+        }
+
+        if (is_timing_command(line)) {
+            bool per_sensor;
+            const char* error = parse_timing_command(line, per_sensor);
+            if (error != NULL)
+                return fail(error, line);
+
+            if (per_sensor && !per_sensor_timing)
+                fill(stream_time, stream_time + undefined_sensor_type, time);
+            if (!per_sensor && !write_records(pending, out)) {
+                perror(argv[2]);
+                return EXIT_FAILURE;
+            }
+            per_sensor_timing = per_sensor;
+            continue;
+        }
+
+        // traces store every sample, just like the backend generates them
+        if (is_generate_command(line)) {
+            GenerateCommand command;
+            const char* error = parse_generate_command(line, command);
+            if (error != NULL)
+                return fail(error, line);
+            if (!created[command.type])
+                return fail("sensor does not exist, you need to create it", line);
+
+            uint64_t& previous = per_sensor_timing ? stream_time[command.type] : time;
+            Generator generator(command, generator_count++);
+            trace::Record record;
+            record.type = command.type;
+            uint64_t offset;
+            while (generator.next(offset, record.values)) {
+                record.time = previous + offset;
+                header.record_count++;
+                pending.push_back(record);
+            }
+            previous += generator.duration();
+            time = max(time, previous);
+
+            if (!per_sensor_timing && !write_records(pending, out)) {
+                perror(argv[2]);
+                return EXIT_FAILURE;
+            }
+            continue;
+        }
+
+        EventCommand command;
+        const char* error = parse_event_command(line, command);
+        if (error != NULL)
+            return fail(error, line);
+        if (!created[command.type])
+            return fail("sensor does not exist, you need to create it", line);
+
+        // accumulate like the backend does when replaying the text format
+        uint64_t& previous = per_sensor_timing ? stream_time[command.type] : time;
+        previous += uint64_t(double(command.delay) * 1000000);
+        time = max(time, previous);
+
+        trace::Record record;
+        record.time = previous;
+        record.type = command.type;
+        if (command.type == ubuntu_sensor_type_proximity) {
+            record.values[0] = float(command.distance);
+            record.values[1] = record.values[2] = 0;
+        } else {
+            record.values[0] = command.x;
+            record.values[1] = command.y;
+            record.values[2] = command.z;
+        }
+
+        header.record_count++;
+        pending.push_back(record);
+        if (!per_sensor_timing && !write_records(pending, out)) {
+            perror(argv[2]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (!write_records(pending, out)
+        || fseek(out, 0, SEEK_SET) < 0
+        || fwrite(&header, sizeof(header), 1, out) != 1
+        || fwrite(sensors, sizeof(trace::Sensor), header.sensor_count, out) != header.sensor_count
+        || fclose(out) != 0) {
+        perror(argv[2]);
+        return EXIT_FAILURE;
+    }
+
+    close(in);
+
+    cout << "Converted " << header.sensor_count << " sensors and " << header.record_count << " events" << endl;
+    return EXIT_SUCCESS;
+}
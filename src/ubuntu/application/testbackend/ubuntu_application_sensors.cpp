@@ -19,26 +19,47 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <sys/mman.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
 
 #include <ubuntu/application/sensors/accelerometer.h>
 #include <ubuntu/application/sensors/proximity.h>
 #include <ubuntu/application/sensors/light.h>
 #include <ubuntu/application/sensors/orientation.h>
 #include <ubuntu/application/sensors/haptic.h>
+#include <ubuntu/application/sensors/delivery.h>
+#include <ubuntu/application/sensors/decimation.h>
+#include <ubuntu/application/sensors/stats.h>
+#include <ubuntu/application/sensors/test_context.h>
+
+#include <private/application/sensors/decimator.h>
+#include <private/application/sensors/multiplexer.h>
+#include <private/application/sensors/sensor_statistics.h>
+#include <private/application/sensors/sensor_trace.h>
+#include <private/platform/seqlock.h>
+#include <private/platform/spsc_ring.h>
+
+#include "sensor_commands.h"
 
 #include <cstddef>
+#include <cstdint>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <cerrno>
 #include <csignal>
 #include <iostream>
 #include <sstream>
-#include <fstream>
 #include <stdexcept>
+#include <algorithm>
 #include <chrono>
 #include <map>
+#include <deque>
+#include <vector>
 #include <memory>
 #include <mutex>
 #include <condition_variable>
@@ -62,77 +83,581 @@ using namespace std;
  *
  ***************************************/
 
-enum ubuntu_sensor_type
-{
-    first_defined_sensor_type = 0,
-    ubuntu_sensor_type_accelerometer = first_defined_sensor_type,
-    ubuntu_sensor_type_magnetic_field,
-    ubuntu_sensor_type_gyroscope,
-    ubuntu_sensor_type_light,
-    ubuntu_sensor_type_proximity,
-    ubuntu_sensor_type_orientation,
-    ubuntu_sensor_type_linear_acceleration,
-    ubuntu_sensor_type_rotation_vector,
-    undefined_sensor_type
+// a single scripted reading
+struct TestReading
+{
+    uint64_t timestamp;
+    float x, y, z;
+    UASProximityDistance distance;
 };
 
-// this is only internal API, so we make everything public
+// readings stored as structure of arrays, so that they can be handed out as UASVectorBatch
+struct TestReadingBuffer
+{
+    void push(const TestReading& r)
+    {
+        timestamp.push_back(r.timestamp);
+        x.push_back(r.x);
+        y.push_back(r.y);
+        z.push_back(r.z);
+        distance.push_back(r.distance);
+    }
+
+    void clear()
+    {
+        timestamp.clear();
+        x.clear();
+        y.clear();
+        z.clear();
+        distance.clear();
+    }
+
+    void swap(TestReadingBuffer& other)
+    {
+        timestamp.swap(other.timestamp);
+        x.swap(other.x);
+        y.swap(other.y);
+        z.swap(other.z);
+        distance.swap(other.distance);
+    }
+
+    size_t size() const { return timestamp.size(); }
+
+    vector<uint64_t> timestamp;
+    vector<float> x, y, z;
+    vector<UASProximityDistance> distance;
+};
+
+// a callback together with its context, so that both are published at once
+template<typename Function>
+struct TestCallback
+{
+    Function function;
+    void* context;
+};
+
+class ReplayClock;
+
+static uint64_t monotonic_now()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return uint64_t(now.tv_sec) * 1000000000ULL + now.tv_nsec;
+}
+
+/* this is only internal API, so we make everything public; state that
+ * applications set or read on their threads is accessed atomically */
 struct TestSensor
 {
-    TestSensor(ubuntu_sensor_type _type, float _min_value, float _max_value, float _resolution) :
+    typedef TestCallback<void (*)(void*, void*)> EventCallback;
+    typedef TestCallback<void (*)(const UASVectorBatch*, void*)> BatchCallback;
+
+    // readings buffered in deferred delivery mode before new ones are dropped
+    static const size_t queue_capacity = 256;
+
+    // readings are timestamped with origin + their position on the clock's timeline
+    TestSensor(ubuntu_sensor_type _type, float _min_value, float _max_value, float _resolution,
+               const ReplayClock& _clock, uint64_t _origin) :
         type(_type),
         enabled(false),
         resolution(_resolution),
         min_delay(0),
         min_value(_min_value),
         max_value(_max_value),
-        on_event_cb(NULL),
-        event_cb_context(NULL),
-        x(_min_value),
-        y(_min_value),
-        z(_min_value),
-        distance((UASProximityDistance) 0),  // LP#1256969
-        timestamp(0)
+        current(TestReading { 0, _min_value, _min_value, _min_value,
+                              (UASProximityDistance) 0 }),  // LP#1256969
+        sample_period(0),
+        last_sample(UINT64_MAX),
+        max_report_latency(0),
+        fifo_deadline(UINT64_MAX),
+        delivery_mode(U_SENSORS_DELIVERY_IMMEDIATE),
+        delivery_fd(-1),
+        clock(_clock),
+        origin(_origin)
     {}
 
+    ~TestSensor()
+    {
+        if (delivery_fd >= 0)
+            close(delivery_fd);
+    }
+
+    // wall clock the timestamps of a real-time replay start from; durations
+    // are measured with monotonic_now(), which does not jump
+    static uint64_t now()
+    {
+        return chrono::duration_cast<chrono::nanoseconds>(
+            chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    // timestamp a reading handed out now would have, for its latency
+    uint64_t delivery_time() const;
+
+    /* Queue a reading and report everything that is queued once the oldest
+     * queued reading has been held for max_report_latency; this emulates the
+     * hardware FIFO of a batching sensor hub. The replay thread also flushes
+     * the FIFO once that deadline passes without a newer reading. Without
+     * batching every reading is reported right away. Readings closer than the
+     * sampling period to the previous one are never sampled, the others are
+     * reduced to the rate requested with ua_sensors_set_decimation() first.
+     * Only called by the replay thread. */
+    void push_reading(const TestReading& reading)
+    {
+        const uint64_t period = __atomic_load_n(&sample_period, __ATOMIC_RELAXED);
+        if (period > 0 && last_sample != UINT64_MAX && reading.timestamp - last_sample < period)
+            return;
+        last_sample = reading.timestamp;
+
+        statistics.record_received();
+
+        TestReading r = reading;
+        const float in[3] = { reading.x, reading.y, reading.z };
+        float out[3];
+        if (!decimator.process(reading.timestamp, in, out)) {
+            statistics.record_decimated();
+            return;
+        }
+
+        r.x = out[0];
+        r.y = out[1];
+        r.z = out[2];
+
+        const uint64_t latency = __atomic_load_n(&max_report_latency, __ATOMIC_RELAXED);
+        {
+            lock_guard<mutex> lk(fifo_mtx);
+            fifo.push(r);
+            if (r.timestamp - fifo.timestamp.front() < latency) {
+                if (fifo.size() == 1)
+                    __atomic_store_n(&fifo_deadline, r.timestamp + latency, __ATOMIC_RELAXED);
+                return;
+            }
+        }
+
+        flush();
+    }
+
+    // timestamp at which the FIFO is due to be flushed, UINT64_MAX if it is empty
+    uint64_t flush_deadline() const
+    {
+        return __atomic_load_n(&fifo_deadline, __ATOMIC_RELAXED);
+    }
+
+    // hand out everything the FIFO holds, on the replay thread
+    void flush()
+    {
+        flush(outgoing);
+    }
+
+    // hand out everything the FIFO holds, on an application thread
+    void drain_fifo()
+    {
+        TestReadingBuffer readings;
+        flush(readings);
+    }
+
+    // readings is scratch space owned by the calling thread; callbacks are
+    // invoked without holding fifo_mtx, so they may reconfigure the sensor
+    void flush(TestReadingBuffer& readings)
+    {
+        unique_lock<mutex> lk(fifo_mtx);
+        __atomic_store_n(&fifo_deadline, UINT64_MAX, __ATOMIC_RELAXED);
+        if (fifo.size() == 0)
+            return;
+
+        if (__atomic_load_n(&delivery_mode, __ATOMIC_ACQUIRE) != U_SENSORS_DELIVERY_IMMEDIATE) {
+            // fifo_mtx serializes the producers of the queue
+            for (size_t i = 0; i < fifo.size(); ++i) {
+                TestReading r { fifo.timestamp[i], fifo.x[i], fifo.y[i], fifo.z[i], fifo.distance[i] };
+                if (!queue.push(r))
+                    statistics.record_dropped();
+            }
+            fifo.clear();
+
+            static const uint64_t one = 1;
+            if (write(delivery_fd, &one, sizeof(one)) < 0)
+                perror("TestSensor ERROR: Failed to signal pending readings");
+            return;
+        }
+
+        readings.swap(fifo);
+        lk.unlock();
+
+        deliver(readings);
+        readings.clear();
+    }
+
+    /* call the reading callbacks for the given readings on the current thread;
+     * the readings are handed out together, so the replay clock is read once */
+    void deliver(const TestReadingBuffer& readings)
+    {
+        const EventCallback event_callback = event_cb.load();
+        const uint64_t delivered = readings.size() > 0 ? delivery_time() : 0;
+        for (size_t i = 0; i < readings.size(); ++i) {
+            TestReading r { readings.timestamp[i], readings.x[i], readings.y[i], readings.z[i], readings.distance[i] };
+            current.store(r);
+
+            statistics.record_delivery(r.timestamp, delivered);
+            if (event_callback.function != NULL) {
+                uint64_t start = monotonic_now();
+                event_callback.function(this, event_callback.context);
+                statistics.record_callback(monotonic_now() - start);
+            }
+        }
+
+        const BatchCallback batch_callback = batch_cb.load();
+        if (batch_callback.function != NULL && readings.size() > 0) {
+            UASVectorBatch batch { uint32_t(readings.size()), readings.timestamp.data(),
+                                   readings.x.data(), readings.y.data(), readings.z.data() };
+            uint64_t start = monotonic_now();
+            batch_callback.function(&batch, batch_callback.context);
+            statistics.record_callback(monotonic_now() - start);
+        }
+    }
+
+    bool is_enabled() const
+    {
+        return __atomic_load_n(&enabled, __ATOMIC_ACQUIRE);
+    }
+
+    void set_enabled(bool enable)
+    {
+        __atomic_store_n(&enabled, enable, __ATOMIC_RELEASE);
+
+        // a disabled sensor does not hold back readings it has already taken
+        if (!enable)
+            drain_fifo();
+    }
+
+    void set_batching(uint64_t period, uint64_t max_latency)
+    {
+        __atomic_store_n(&sample_period, period, __ATOMIC_RELAXED);
+        __atomic_store_n(&max_report_latency, max_latency, __ATOMIC_RELAXED);
+
+        // readings held back under the previous configuration are reported right away
+        drain_fifo();
+    }
+
+    void set_reading_cb(void (*cb)(void*, void*), void* ctx)
+    {
+        event_cb.store(EventCallback { cb, ctx });
+    }
+
+    void set_batch_reading_cb(void (*cb)(const UASVectorBatch*, void*), void* ctx)
+    {
+        batch_cb.store(BatchCallback { cb, ctx });
+    }
+
+    UStatus set_decimation(uint64_t interval, UASensorsFilter filter, float cutoff)
+    {
+        // averaging discrete near/far readings yields neither
+        if (type == ubuntu_sensor_type_proximity && filter != U_SENSORS_FILTER_NONE)
+            return U_STATUS_ERROR;
+
+        decimator.configure(interval, filter, cutoff);
+        return U_STATUS_SUCCESS;
+    }
+
+    UStatus set_delivery_mode(UASensorsDeliveryMode mode)
+    {
+        if (mode == U_SENSORS_DELIVERY_DEFERRED && delivery_fd < 0) {
+            delivery_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (delivery_fd < 0)
+                return U_STATUS_ERROR;
+        }
+
+        __atomic_store_n(&delivery_mode, mode, __ATOMIC_RELEASE);
+        return U_STATUS_SUCCESS;
+    }
+
+    uint32_t dispatch_pending()
+    {
+        // reset readiness before draining, readings queued afterwards signal again
+        uint64_t value;
+        if (delivery_fd >= 0 && read(delivery_fd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+            perror("TestSensor ERROR: Failed to reset delivery fd");
+
+        TestReading r;
+        while (queue.pop(r))
+            pending.push(r);
+
+        uint32_t delivered = pending.size();
+        deliver(pending);
+        pending.clear();
+
+        return delivered;
+    }
+
     ubuntu_sensor_type type;
     bool enabled;
     float resolution;
     uint32_t min_delay;
     float min_value, max_value;
-    void (*on_event_cb)(void*, void*);
-    void* event_cb_context;
+    ubuntu::platform::SeqLock<EventCallback> event_cb;
+    ubuntu::platform::SeqLock<BatchCallback> batch_cb;
 
     /* current value; note that we do not track separate Event objects/pointers
-     * at all, and just always deliver the current value */
+     * at all, and just always deliver the current value. The event getters
+     * may read it on any thread while the next reading is delivered. */
+    ubuntu::platform::SeqLock<TestReading> current;
+
+    /* emulated hardware FIFO, see push_reading(); last_sample and outgoing
+     * are only used by the replay thread */
+    uint64_t sample_period;
+    uint64_t last_sample;
+    uint64_t max_report_latency;
+    mutex fifo_mtx;
+    TestReadingBuffer fifo;
+    uint64_t fifo_deadline;
+    TestReadingBuffer outgoing;
+    ubuntu::application::sensors::Decimator decimator;
+
+    /* counters for ua_sensors_get_stats(), updated by the replay thread and dispatch_pending() */
+    ubuntu::application::sensors::SensorStatistics statistics;
+
+    /* deferred delivery: filled by the timer thread, drained by dispatch_pending() */
+    int delivery_mode;
+    int delivery_fd;
+    ubuntu::platform::SpscRing<TestReading, queue_capacity> queue;
+    TestReadingBuffer pending;
+
+    /* latencies are measured on the replay timeline, see delivery_time() */
+    const ReplayClock& clock;
+    const uint64_t origin;
+};
+
+// the replay clock of a controller; UBUNTU_PLATFORM_API_SENSOR_TEST_CLOCK selects
+// it unless the controller asks for one, real by default. Returns
+// U_SENSORS_TEST_CLOCK_DEFAULT if the variable is invalid.
+static UASensorsTestClock replay_clock(UASensorsTestClock requested)
+{
+    if (requested != U_SENSORS_TEST_CLOCK_DEFAULT)
+        return requested;
+
+    const char* clock = getenv("UBUNTU_PLATFORM_API_SENSOR_TEST_CLOCK");
+    if (clock == NULL || strcmp(clock, "real") == 0)
+        return U_SENSORS_TEST_CLOCK_REAL;
+    if (strcmp(clock, "virtual") == 0)
+        return U_SENSORS_TEST_CLOCK_VIRTUAL;
+
+    cerr << "TestSensor ERROR: UBUNTU_PLATFORM_API_SENSOR_TEST_CLOCK must be real or virtual, got " << clock << endl;
+    return U_SENSORS_TEST_CLOCK_DEFAULT;
+}
+
+// the remaining samples of a gen command
+struct GeneratedEvents
+{
+    GeneratedEvents(const Generator& generator, uint64_t start)
+        : generator(generator),
+          start(start)
+    {}
+
+    Generator generator;
+    uint64_t start; // position of the command on the replay timeline [ns]
+};
+
+// an event that has been parsed ahead of time; without a sensor, a change of
+// the replay speed that takes effect at its position in the stream. Events
+// of a gen command share a single entry, which the replay thread refills with
+// the next sample until the generator is exhausted.
+struct ScheduledEvent
+{
+    uint64_t time; // position on the replay timeline [ns]
+    TestSensor* sensor;
     float x, y, z;
     UASProximityDistance distance;
-    uint64_t timestamp;
+    float speed;
+    uint64_t sequence; // order of scheduling, breaks ties between streams
+    shared_ptr<GeneratedEvents> generated;
 };
 
+/* Maps the replay timeline onto CLOCK_MONOTONIC, scaled by the replay speed.
+ * The timeline starts at 0 when the controller is created and runs in step
+ * with the wall clock at speed 1. Speed 0 replays unthrottled: every event is
+ * due right away and the timeline advances with the events fired. */
+class ReplayClock
+{
+  public:
+    // a virtual clock only moves on release(), independently of the speed
+    explicit ReplayClock(bool virtual_time)
+        : virtual_time(virtual_time),
+          speed(1),
+          anchor_time(0),
+          anchor_wall(virtual_time ? 0 : monotonic_now()),
+          position(0),
+          limit(0),
+          generation(0)
+    {
+    }
+
+    bool is_virtual() const
+    {
+        return virtual_time;
+    }
+
+    // position on the timeline that corresponds to now
+    uint64_t now() const
+    {
+        lock_guard<mutex> lk(mtx);
+        if (virtual_time)
+            return limit;
+        if (speed == 0)
+            return position;
+        return anchor_time + uint64_t(double(monotonic_now() - anchor_wall) * speed);
+    }
+
+    /* Position on the timeline at which a reading is handed out now; virtual
+     * and unthrottled clocks stand at the last event fired. Called for every
+     * delivered reading, so it does not take the lock: the anchor is read
+     * again if set_speed() moved it meanwhile, see generation. */
+    uint64_t delivery_time() const
+    {
+        for (;;) {
+            const uint32_t before = __atomic_load_n(&generation, __ATOMIC_ACQUIRE);
+            float current_speed;
+            __atomic_load(&speed, &current_speed, __ATOMIC_RELAXED);
+            const uint64_t time = __atomic_load_n(&anchor_time, __ATOMIC_RELAXED);
+            const uint64_t wall = __atomic_load_n(&anchor_wall, __ATOMIC_RELAXED);
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if ((before & 1) != 0 || __atomic_load_n(&generation, __ATOMIC_RELAXED) != before)
+                continue;
+
+            if (virtual_time || current_speed == 0)
+                return __atomic_load_n(&position, __ATOMIC_RELAXED);
+            return time + uint64_t(double(monotonic_now() - wall) * current_speed);
+        }
+    }
+
+    // CLOCK_MONOTONIC time at which an event is due, 0 if it is due right away,
+    // UINT64_MAX if only release() can make it due
+    uint64_t due(uint64_t time) const
+    {
+        lock_guard<mutex> lk(mtx);
+        if (virtual_time)
+            return time <= limit ? 0 : UINT64_MAX;
+        if (speed == 0)
+            return 0;
+        if (time <= anchor_time)
+            return anchor_wall;
+        return anchor_wall + uint64_t(double(time - anchor_time) / speed);
+    }
+
+    // called by the replay thread for every event it fires
+    void advance(uint64_t time)
+    {
+        lock_guard<mutex> lk(mtx);
+        __atomic_store_n(&position, max(position, time), __ATOMIC_RELAXED);
+    }
+
+    // continue the timeline from the last fired event at a different pace
+    void set_speed(float new_speed)
+    {
+        lock_guard<mutex> lk(mtx);
+        __atomic_store_n(&generation, generation + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        __atomic_store_n(&anchor_time, position, __ATOMIC_RELAXED);
+        __atomic_store_n(&anchor_wall, monotonic_now(), __ATOMIC_RELAXED);
+        __atomic_store(&speed, &new_speed, __ATOMIC_RELAXED);
+        __atomic_store_n(&generation, generation + 1, __ATOMIC_RELEASE);
+    }
+
+    // virtual clock only: move on by duration, returns the new time
+    uint64_t release(uint64_t duration)
+    {
+        lock_guard<mutex> lk(mtx);
+        limit += duration;
+        return limit;
+    }
+
+  private:
+    // fields that delivery_time() reads are written atomically, under mtx
+    const bool virtual_time;
+    mutable mutex mtx;
+    float speed;
+    uint64_t anchor_time;
+    uint64_t anchor_wall;
+    uint64_t position;
+    uint64_t limit;
+    // odd while set_speed() moves the anchor
+    uint32_t generation;
+};
+
+uint64_t TestSensor::delivery_time() const
+{
+    return origin + clock.delivery_time();
+}
+
 /* Singleton which reads the sensor data file and maintains the TestSensor
- * instances */
+ * instances.
+ *
+ * Commands are parsed ahead by a worker thread into per-sensor queues of
+ * events with absolute times on the replay timeline, or taken straight from a
+ * memory mapped binary trace; a single replay thread merges the queues,
+ * sleeps on a timerfd until the earliest event is due and fires it. A slow
+ * consumer thus never delays the following events, and rounding errors do not
+ * accumulate.
+ *
+ * Readings are timestamped with their position on the timeline, so that they
+ * keep their original spacing when replayed faster, slower or unthrottled.
+ * With a virtual clock the timeline starts at 0 and only moves on through
+ * advance_clock(), which makes the replay independent of the host's timing. */
 class SensorController
 {
   public:
-    // Ensure that controller is initialized, and return singleton
+    // Replays path, or commands from a named pipe of its own if path is NULL.
+    // Only the environment-configured context publishes to the multiplexer.
+    // Check valid() before use, setup failures are reported on stderr.
+    SensorController(const char* path, bool environment,
+                     UASensorsTestClock requested_clock = U_SENSORS_TEST_CLOCK_DEFAULT);
+    ~SensorController();
+
+    // Ensure that the environment-configured controller is initialized, and return it
     static SensorController& instance()
     {
-        static SensorController _inst;
+        static SensorController _inst(getenv("UBUNTU_PLATFORM_API_SENSOR_TEST"), true);
+        // the backend has no way to report this to the application
+        if (!_inst.valid())
+            abort();
         return _inst;
     }
 
+    bool valid() const
+    {
+        return setup_ok;
+    }
+
+    // Controller the calling thread creates sensors from
+    static SensorController& current()
+    {
+        return bound != NULL ? *bound : instance();
+    }
+
+    static void make_current(SensorController* controller)
+    {
+        bound = controller;
+    }
+
+    // Named pipe of a dynamic controller, or NULL
+    const char* fifo() const
+    {
+        return dynamic ? fifo_path.c_str() : NULL;
+    }
+
+    // Release the events of the next duration [ns] of a virtual clock and wait
+    // until they have been fired; returns false if the clock is not virtual
+    bool advance_clock(uint64_t duration, bool wait_for_input);
+
     // Return TestSensor of given type, or NULL if it doesn't exist
     TestSensor* get(ubuntu_sensor_type type, bool no_block = false)
     {
+        // sensors may be created by the worker while any thread asks for them
+        unique_lock<mutex> lk(create_mtx);
         if (!no_block && dynamic) {
-            unique_lock<mutex> lk(create_mtx);
             create_cv.wait(lk, [this, type]{
                 try {
                     sensors.at(type).get();
                     return true;
                 } catch (const out_of_range&) {
-                    cerr << "TestSensor WARNING: Requested sensor " << name_from_type(type) << " not yet created, blocking thread until create event received" << endl;        
+                    cerr << "TestSensor WARNING: Requested sensor " << sensor_type_name(type) << " not yet created, blocking thread until create event received" << endl;        
                     return false;
                 }
             });
@@ -145,358 +670,824 @@ class SensorController
     }
 
   private:
-    SensorController();
-    ~SensorController();
-    bool fifo_take_command();
+    static thread_local SensorController* bound;
+    // number of controllers created besides the environment-configured one
+    static unsigned int context_count;
+
     bool next_command();
+    void parse_ahead(bool have_command);
     bool process_create_command();
     void process_event_command();
-    void setup_timer(unsigned delay_ms);
-    static void on_timer(union sigval sval);
-
-    static ubuntu_sensor_type type_from_name(const string& type)
-    {
-        if (type == "light")
-            return ubuntu_sensor_type_light;
-        if (type == "proximity")
-            return ubuntu_sensor_type_proximity;
-        if (type == "accel")
-            return ubuntu_sensor_type_accelerometer;
-
-        cerr << "TestSensor ERROR: unknown sensor type " << type << endl;
-        abort();
-    }
-
-    static const char* name_from_type(ubuntu_sensor_type type)
-    {
-        if (type == ubuntu_sensor_type_light)
-            return "light";
-        if (type == ubuntu_sensor_type_proximity)
-            return "proximity";
-        if (type == ubuntu_sensor_type_accelerometer)
-            return "accelerometer";
-
-        return "ERROR_TYPE";
-    }
-
+    void process_speed_command();
+    void process_timing_command();
+    void process_generate_command();
+    void process_advance_command();
+    static bool next_sample(ScheduledEvent& event);
+    bool create_sensor(ubuntu_sensor_type type, float min, float max, float resolution);
+    bool load_trace(const char* path);
+    void play_trace();
+    uint64_t next_time(ubuntu_sensor_type type, uint64_t delay);
+    bool schedule(const ScheduledEvent& event);
+    deque<ScheduledEvent>* earliest();
+    TestSensor* next_flush(uint64_t& time);
+    void replay();
+    bool wait_until(uint64_t deadline);
+    void set_speed(float speed);
+    void finish_input();
+    void fire(const ScheduledEvent& event);
+    void describe(const TestSensor& sensor);
+    void publish(const TestSensor& sensor, const TestReading& r);
+
+    bool setup_ok;
     map<ubuntu_sensor_type, shared_ptr<TestSensor>> sensors;
-    ifstream data;
+    // the same sensors, for the replay thread to find batching FIFOs without create_mtx
+    TestSensor* batching[undefined_sensor_type];
+    // stand-in multiplexer source, see README
+    unique_ptr<ubuntu::application::sensors::multiplexer::Publisher> publisher;
+    int data_fd;
+    LineReader commands;
+    // mapped binary trace, if any
+    void* trace_data;
+    size_t trace_size;
     bool dynamic;
     int fifo_fd;
+    // only set once the named pipe has been created
     string fifo_path;
-    bool block;
-    condition_variable comm_cv;
-    mutex mtx;
     thread worker;
     condition_variable create_cv;
     mutex create_mtx;
     bool exit;
-
-    // current command/event
-    string current_command;
-    TestSensor* event_sensor;
-    float event_x, event_y, event_z;
-    UASProximityDistance event_distance;
+    // readable once the controller shuts down
+    int exit_fd;
+
+    // events parsed ahead, one queue per sensor type and one for speed
+    // changes, each in the order of their times
+    static const size_t max_scheduled_events = 4096;
+    static const int control_stream = undefined_sensor_type;
+    deque<ScheduledEvent> scheduled[undefined_sensor_type + 1];
+    uint64_t next_sequence;
+    // time of the event the replay thread sleeps for, UINT64_MAX if it does not
+    uint64_t waiting_for;
+    // readable once an event earlier than waiting_for has been scheduled
+    int wakeup_fd;
+    mutex schedule_mtx;
+    condition_variable scheduled_cv;
+    condition_variable space_cv;
+    // advance_clock() waits for the replay thread to run out of due events,
+    // and for a data file to be parsed beyond the released time
+    condition_variable idle_cv;
+    bool idle;
+    bool input_done;
+    bool input_full;
+    uint64_t scheduled_until;
+    int timer_fd;
+    thread replayer;
+
+    // only used by the worker: time of the latest event, and of the latest
+    // event per sensor while delays are relative to the same sensor
+    uint64_t last_time;
+    bool per_sensor_timing;
+    uint64_t stream_time[undefined_sensor_type];
+    uint64_t generator_count;
+
+    // the kind of clock, DEFAULT if it could not be determined
+    const UASensorsTestClock clock_type;
+    ReplayClock clock;
+    // timestamps of the start of the replay timeline
+    uint64_t realtime_origin;
+    uint64_t monotonic_origin;
+
+    // current command, valid until the next one is read
+    Token current_command;
 };
 
-SensorController::SensorController()
-    : dynamic(true),
+thread_local SensorController* SensorController::bound = NULL;
+unsigned int SensorController::context_count = 0;
+
+SensorController::SensorController(const char* path, bool environment, UASensorsTestClock requested_clock)
+    : setup_ok(false),
+      batching(),
+      data_fd(-1),
+      trace_data(NULL),
+      trace_size(0),
+      dynamic(true),
       fifo_fd(-1),
-      block(false),
-      exit(false)
+      exit(false),
+      exit_fd(-1),
+      next_sequence(0),
+      waiting_for(UINT64_MAX),
+      wakeup_fd(-1),
+      idle(false),
+      input_done(true),
+      input_full(false),
+      scheduled_until(0),
+      timer_fd(-1),
+      last_time(0),
+      per_sensor_timing(false),
+      stream_time(),
+      generator_count(0),
+      clock_type(replay_clock(requested_clock)),
+      clock(clock_type == U_SENSORS_TEST_CLOCK_VIRTUAL),
+      realtime_origin(clock.is_virtual() ? 0 : TestSensor::now()),
+      monotonic_origin(clock.is_virtual() ? 0 : uint64_t(chrono::duration_cast<chrono::nanoseconds>(
+                           chrono::steady_clock::now().time_since_epoch()).count()))
 {
-    const char* path = getenv("UBUNTU_PLATFORM_API_SENSOR_TEST");
+    if (clock_type == U_SENSORS_TEST_CLOCK_DEFAULT)
+        return;
+    if (clock.is_virtual())
+        cout << "TestSensor INFO: Replaying events on a virtual clock" << endl;
+
     if (path != NULL)
         dynamic = false;
 
+    const char* speed = getenv("UBUNTU_PLATFORM_API_SENSOR_TEST_SPEED");
+    if (speed != NULL) {
+        float factor;
+        if (!parse_speed(Token(speed, strlen(speed)), factor)) {
+            cerr << "TestSensor ERROR: UBUNTU_PLATFORM_API_SENSOR_TEST_SPEED must be a positive factor or unthrottled, got " << speed << endl;
+            return;
+        }
+        set_speed(factor);
+    }
+
+    exit_fd = eventfd(0, EFD_CLOEXEC);
+    wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (exit_fd < 0 || wakeup_fd < 0 || timer_fd < 0) {
+        perror("TestSensor ERROR: Failed to set up event replay");
+        return;
+    }
+
+    const char* segment = ubuntu::application::sensors::multiplexer::segment_name();
+    if (environment && segment != NULL) {
+        publisher.reset(ubuntu::application::sensors::multiplexer::Publisher::create(segment));
+        if (!publisher) {
+            cerr << "TestSensor ERROR: Failed to create multiplexer segment " << segment << ": " << strerror(errno) << endl;
+            return;
+        }
+        cout << "TestSensor INFO: Publishing readings to multiplexer segment " << segment << endl;
+    }
+
+    replayer = thread([this] { replay(); });
+
     // Either we are using a named pipe (dynamic) or a static file for event injection
     if (dynamic) {
         // create named pipe for event injection
         stringstream ss;
         ss << "/tmp/sensor-fifo-" << getpid();
-        fifo_path = ss.str();
+        if (!environment)
+            ss << "-" << __atomic_add_fetch(&context_count, 1, __ATOMIC_RELAXED);
         
-        int ret = mkfifo(fifo_path.c_str(), S_IFIFO | 0666);
+        int ret = mkfifo(ss.str().c_str(), S_IFIFO | 0666);
         if (ret < 0) {
-            cerr << "TestSensor ERROR: Failed to create named pipe at " << fifo_path << endl;
-            abort();
+            cerr << "TestSensor ERROR: Failed to create named pipe at " << ss.str() << ": " << strerror(errno) << endl;
+            return;
         }
+        fifo_path = ss.str();
 
-        fifo_fd = open(fifo_path.c_str(), O_RDWR);
+        fifo_fd = open(fifo_path.c_str(), O_RDWR | O_CLOEXEC);
         if (fifo_fd < 0) {
-            cerr << "TestSensor ERROR: Failed to open named pipe at " << fifo_path << endl;
-            abort();
+            cerr << "TestSensor ERROR: Failed to open named pipe at " << fifo_path << ": " << strerror(errno) << endl;
+            return;
         }
         cout << "TestSensor INFO: Setup for DYNAMIC event injection over named pipe " << fifo_path << endl;
+        commands.reset(fifo_fd, exit_fd);
 
-        worker = move(thread([this] {
-            while (fifo_take_command()) {
-                if (current_command.find("create") == string::npos)
-                    process_event_command();
-                else
-                    process_create_command();
+        // sensors are only described once they get created
+        if (publisher)
+            publisher->start();
 
-                if (exit)
-                    break;
-            }
-        }));
+        input_done = false;
+        worker = thread([this] { parse_ahead(false); });
     } else {
-        data.open(path);
-        if (!data.is_open()) {
+        data_fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (data_fd < 0) {
             cerr << "TestSensor ERROR: Failed to open data file " << path << ": " << strerror(errno) << endl;
-            abort();
+            return;
         }
         
+        char magic[sizeof(ubuntu::application::sensors::trace::magic)];
+        ssize_t magic_size = pread(data_fd, magic, sizeof(magic), 0);
+        if (magic_size > 0 && ubuntu::application::sensors::trace::is_trace(magic, magic_size)) {
+            cout << "TestSensor INFO: Setup for STATIC event injection playing back trace " << path << endl;
+            setup_ok = load_trace(path);
+            return;
+        }
+
         cout << "TestSensor INFO: Setup for STATIC event injection reading from " << path << endl;
+        commands.reset(data_fd, exit_fd);
     
         // process all "create" commands
-        while (next_command()) {
+        bool have_command;
+        while ((have_command = next_command())) {
             if (!process_create_command())
                 break;
         }
+
+        if (publisher)
+            publisher->start();
     
         // start event processing
-        if (!data.eof())
-            process_event_command();
+        if (have_command) {
+            input_done = false;
+            worker = thread([this] { parse_ahead(true); });
+        }
     }
+
+    setup_ok = true;
 }
 
 SensorController::~SensorController()
 {
-    if (dynamic) {
+    {
+        lock_guard<mutex> lk(schedule_mtx);
         exit = true;
-        if (worker.joinable())
-            worker.join();
+    }
+    scheduled_cv.notify_all();
+    space_cv.notify_all();
+    idle_cv.notify_all();
+
+    static const uint64_t one = 1;
+    if (exit_fd >= 0 && write(exit_fd, &one, sizeof(one)) < 0)
+        perror("TestSensor ERROR: Failed to signal shutdown");
 
+    if (worker.joinable())
+        worker.join();
+    if (replayer.joinable())
+        replayer.join();
+
+    if (!fifo_path.empty())
         unlink(fifo_path.c_str());
+
+    if (trace_data != NULL)
+        munmap(trace_data, trace_size);
+    if (data_fd >= 0)
+        close(data_fd);
+    if (fifo_fd >= 0)
+        close(fifo_fd);
+    if (timer_fd >= 0)
+        close(timer_fd);
+    if (wakeup_fd >= 0)
+        close(wakeup_fd);
+    if (exit_fd >= 0)
+        close(exit_fd);
+}
+
+bool
+SensorController::next_command()
+{
+    return commands.next(current_command);
+}
+
+// worker thread: process commands until the input ends or we shut down
+void
+SensorController::parse_ahead(bool have_command)
+{
+    while (have_command || next_command()) {
+        have_command = false;
+
+        if (is_create_command(current_command))
+            process_create_command();
+        else if (is_speed_command(current_command))
+            process_speed_command();
+        else if (is_timing_command(current_command))
+            process_timing_command();
+        else if (is_generate_command(current_command))
+            process_generate_command();
+        else if (is_advance_command(current_command))
+            process_advance_command();
+        else
+            process_event_command();
     }
+
+    finish_input();
 }
 
 bool
-SensorController::fifo_take_command()
+SensorController::process_create_command()
 {
-    char buf;
-    int size;
-    string tmp = "";
+    // we only process "create" commands here; if we have something else, stop
+    if (!is_create_command(current_command))
+        return false;
+
+    CreateCommand command;
+    const char* error = parse_create_command(current_command, command);
+    if (error != NULL) {
+        cerr << "TestSensor ERROR: " << error << " in " << current_command << endl;
+        abort();
+    }
 
-    // block until last event has fired
-    unique_lock<mutex> lk(mtx);
-    comm_cv.wait(lk, [this] { if (block) { return false; } else { block = true; return true; }});
+    return create_sensor(command.type, command.min_value, command.max_value, command.resolution);
+}
 
-    tmp.clear();
-    while (read(fifo_fd, &buf, sizeof(char))) {
-        if (buf == '\n' || buf == '#')
-            break;
-        tmp.append(1, buf);
+void
+SensorController::process_event_command()
+{
+    EventCommand command;
+
+    //cout << "TestSensor: processing event " << current_command << endl;
+
+    const char* error = parse_event_command(current_command, command);
+    if (error != NULL) {
+        cerr << "TestSensor ERROR: " << error << " in " << current_command << endl;
+        abort();
     }
-    if (buf == '#') { // comment input (from piped file)
-        // consume rest of line
-        while (read(fifo_fd, &buf, sizeof(char))) {
-            if (buf == '\n')
-                break;
-        }
-        if (tmp.size() == 0) {
-            block = false;
-            return true;
-        }
+
+    ScheduledEvent event { 0, get(command.type, true), command.x, command.y, command.z, command.distance, 0 };
+    if (event.sensor == NULL) {
+        cerr << "TestSensor ERROR: sensor does not exist, you need to create it: " << current_command << endl;
+        abort();
     }
 
-    tmp.erase(0, tmp.find_first_not_of(" \t"));
-    tmp.erase(tmp.find_last_not_of(" \t") + 1);
+    // fire after given delay, relative to the previous event
+    event.time = next_time(command.type, uint64_t(double(command.delay) * 1000000));
+    schedule(event);
+}
 
-    if (tmp.size() == 0)
-        return true;
+void
+SensorController::process_speed_command()
+{
+    float speed;
+    const char* error = parse_speed_command(current_command, speed);
+    if (error != NULL) {
+        cerr << "TestSensor ERROR: " << error << " in " << current_command << endl;
+        abort();
+    }
 
-    // if create command, dont block
-    if (tmp.find("create") != string::npos)
-        block = false;
+    // applies to all events after the latest one so far
+    ScheduledEvent event { next_time(undefined_sensor_type, 0), NULL, 0, 0, 0, U_PROXIMITY_FAR, speed };
+    schedule(event);
+}
 
-    current_command = tmp;
+void
+SensorController::process_advance_command()
+{
+    float duration;
+    const char* error = parse_advance_command(current_command, duration);
+    if (error != NULL) {
+        cerr << "TestSensor ERROR: " << error << " in " << current_command << endl;
+        abort();
+    }
 
+    // everything up to here has been scheduled already
+    if (!advance_clock(uint64_t(double(duration) * 1000000), false)) {
+        cerr << "TestSensor ERROR: advance needs UBUNTU_PLATFORM_API_SENSOR_TEST_CLOCK=virtual: " << current_command << endl;
+        abort();
+    }
+}
+
+void
+SensorController::process_timing_command()
+{
+    bool per_sensor;
+    const char* error = parse_timing_command(current_command, per_sensor);
+    if (error != NULL) {
+        cerr << "TestSensor ERROR: " << error << " in " << current_command << endl;
+        abort();
+    }
+
+    // all streams continue from the latest event
+    if (per_sensor && !per_sensor_timing)
+        fill(stream_time, stream_time + undefined_sensor_type, last_time);
+    per_sensor_timing = per_sensor;
+}
+
+void
+SensorController::process_generate_command()
+{
+    GenerateCommand command;
+    const char* error = parse_generate_command(current_command, command);
+    if (error != NULL) {
+        cerr << "TestSensor ERROR: " << error << " in " << current_command << endl;
+        abort();
+    }
+
+    TestSensor* sensor = get(command.type, true);
+    if (sensor == NULL) {
+        cerr << "TestSensor ERROR: sensor does not exist, you need to create it: " << current_command << endl;
+        abort();
+    }
+
+    // samples are evaluated by the replay thread when they are due; the
+    // following commands continue after the last one
+    Generator generator(command, generator_count++);
+    uint64_t end = next_time(command.type, generator.duration());
+
+    ScheduledEvent event { 0, sensor, 0, 0, 0, U_PROXIMITY_FAR, 0 };
+    event.generated = make_shared<GeneratedEvents>(generator, end - generator.duration());
+
+    if (next_sample(event))
+        schedule(event);
+}
+
+// refill a gen command's entry with its next sample, returns false once there is none
+bool
+SensorController::next_sample(ScheduledEvent& event)
+{
+    uint64_t offset;
+    float values[3];
+    if (!event.generated->generator.next(offset, values))
+        return false;
+
+    event.time = event.generated->start + offset;
+    event.x = values[0];
+    event.y = values[1];
+    event.z = values[2];
     return true;
 }
 
 bool
-SensorController::next_command()
+SensorController::create_sensor(ubuntu_sensor_type type, float min, float max, float resolution)
 {
-    while (getline(data, current_command)) {
-        // trim leading and trailing space
-        current_command.erase(0, current_command.find_first_not_of(" \t"));
-        current_command.erase(current_command.find_last_not_of(" \t") + 1);
-        // ignore empty or comment lines
-        if (current_command.size() == 0 || current_command[0] == '#')
-            continue;
-        return true;
+    if (get(type, true) != NULL) {
+        cerr << "TestSensor ERROR: duplicate creation of sensor type " << sensor_type_name(type) << endl;
+        return false;
     }
-    return false;
+
+    {
+        lock_guard<mutex> lk(create_mtx);
+        sensors[type] = make_shared<TestSensor>(type, min, max, resolution, clock, realtime_origin);
+    }
+    __atomic_store_n(&batching[type], sensors[type].get(), __ATOMIC_RELEASE);
+    // only the worker modifies the table
+    describe(*sensors[type]);
+    create_cv.notify_all();
+    return true;
 }
 
+// map a binary trace, create its sensors and start playing it back; returns
+// false if the trace cannot be played back
 bool
-SensorController::process_create_command()
+SensorController::load_trace(const char* path)
 {
-    stringstream ss(current_command, ios_base::in);
-    string token;
+    namespace trace = ubuntu::application::sensors::trace;
 
-    // we only process "create" commands here; if we have something else, stop
-    ss >> token;
-    if (token != "create")
+    struct stat st;
+    if (fstat(data_fd, &st) < 0) {
+        cerr << "TestSensor ERROR: Failed to stat trace " << path << ": " << strerror(errno) << endl;
         return false;
+    }
 
-    ss >> token;
-    ubuntu_sensor_type type = type_from_name(token);
+    trace_size = st.st_size;
+    trace_data = mmap(NULL, trace_size, PROT_READ, MAP_PRIVATE, data_fd, 0);
+    if (trace_data == MAP_FAILED) {
+        cerr << "TestSensor ERROR: Failed to map trace " << path << ": " << strerror(errno) << endl;
+        trace_data = NULL;
+        return false;
+    }
+    madvise(trace_data, trace_size, MADV_SEQUENTIAL);
 
-    if (get(type, true) != NULL) {
-        cerr << "TestSensor ERROR: duplicate creation of sensor type " << token << endl;
+    const char* error = trace::check(trace_data, trace_size);
+    if (error != NULL) {
+        cerr << "TestSensor ERROR: " << error << ": " << path << endl;
         return false;
     }
 
-    float min = 0, max = 0, resolution = 0;
+    const trace::Header* header = static_cast<const trace::Header*>(trace_data);
+    const trace::Sensor* sensor = trace::sensors(trace_data);
+    for (uint32_t i = 0; i < header->sensor_count; ++i, ++sensor) {
+        ubuntu_sensor_type type = ubuntu_sensor_type(sensor->type);
+        if (sensor->type >= undefined_sensor_type) {
+            cerr << "TestSensor ERROR: unsupported sensor type " << sensor->type << " in trace " << path << endl;
+            return false;
+        }
+        create_sensor(type, sensor->min_value, sensor->max_value, sensor->resolution);
+    }
+
+    if (publisher)
+        publisher->start();
 
-    if (type != ubuntu_sensor_type_proximity) {
-        // read min, max, resolution
-        ss >> min >> max >> resolution;
+    if (header->record_count > 0) {
+        input_done = false;
+        worker = thread([this] { play_trace(); });
+    }
 
-        if (max <= min) {
-            cerr << "TestSensor ERROR: max_value must be >= min_value in  " << current_command << endl;
+    return true;
+}
+
+// worker thread: schedule the records of a mapped trace, relative to now
+void
+SensorController::play_trace()
+{
+    namespace trace = ubuntu::application::sensors::trace;
+
+    const trace::Header* header = static_cast<const trace::Header*>(trace_data);
+    const trace::Record* record = trace::records(trace_data);
+    const trace::Record* end = record + header->record_count;
+
+    TestSensor* by_type[undefined_sensor_type];
+    for (int type = first_defined_sensor_type; type < undefined_sensor_type; ++type)
+        by_type[type] = get(ubuntu_sensor_type(type), true);
+
+    uint64_t start = clock.now();
+    uint64_t previous = 0;
+
+    for (; record != end; ++record) {
+        if (record->type >= undefined_sensor_type || by_type[record->type] == NULL) {
+            cerr << "TestSensor ERROR: trace record for sensor type " << record->type << " which is not in the sensor table" << endl;
             abort();
         }
-        if (resolution <= 0) {
-            cerr << "TestSensor ERROR: resolution must be > 0 in " << current_command << endl;
+        if (record->time < previous) {
+            cerr << "TestSensor ERROR: trace records are not sorted by time" << endl;
             abort();
         }
+        previous = record->time;
+
+        ScheduledEvent event { start + record->time, by_type[record->type],
+                               record->values[0], record->values[1], record->values[2],
+                               UASProximityDistance(int(record->values[0])), 0 };
+        if (!schedule(event))
+            break;
     }
 
-    sensors[type] = make_shared<TestSensor>(type, min, max, resolution);
-    create_cv.notify_all();
-    return true;
+    finish_input();
 }
 
-void
-SensorController::process_event_command()
+// chain the event times while we are ahead; after the input went idle count
+// from now instead of firing a burst of overdue events. With per-sensor
+// timing the delay is relative to the previous event of the same sensor.
+uint64_t
+SensorController::next_time(ubuntu_sensor_type type, uint64_t delay)
 {
-    stringstream ss(current_command, ios_base::in);
-    int delay;
+    // a virtual clock moves independently of the input
+    const uint64_t now = clock.now();
+    if (!clock.is_virtual() && last_time < now) {
+        last_time = now;
+        for (uint64_t& time : stream_time)
+            time = max(time, now);
+    }
 
-    //cout << "TestSensor: processing event " << current_command << endl;
+    uint64_t& previous = per_sensor_timing && type != undefined_sensor_type ? stream_time[type] : last_time;
+    previous += delay;
+    last_time = max(last_time, previous);
+    return previous;
+}
 
-    // parse delay
-    ss >> delay;
-    if (delay <= 0) {
-        cerr << "TestSensor ERROR: delay must be positive in command " << current_command << endl;
-        abort();
+// queue an event for the replay thread, returns false on shutdown
+bool
+SensorController::schedule(const ScheduledEvent& event)
+{
+    deque<ScheduledEvent>& stream = scheduled[event.sensor != NULL ? int(event.sensor->type) : control_stream];
+
+    unique_lock<mutex> lk(schedule_mtx);
+    if (stream.size() >= max_scheduled_events) {
+        input_full = true;
+        idle_cv.notify_all();
+        space_cv.wait(lk, [this, &stream] { return exit || stream.size() < max_scheduled_events; });
+        input_full = false;
     }
+    if (exit)
+        return false;
 
-    // parse sensor type
-    string token;
-    ss >> token;
-    ubuntu_sensor_type type = type_from_name(token);
-    event_sensor = get(type, true);
-    if (event_sensor == NULL) {
-        cerr << "TestSensor ERROR: sensor does not exist, you need to create it: " << token << endl;
-        abort();
+    stream.push_back(event);
+    stream.back().sequence = next_sequence++;
+    scheduled_until = max(scheduled_until, event.time);
+
+    // another stream may have an earlier event than the replay thread sleeps for
+    if (event.time < waiting_for) {
+        waiting_for = UINT64_MAX;
+        idle = false;
+        static const uint64_t one = 1;
+        if (write(wakeup_fd, &one, sizeof(one)) < 0)
+            perror("TestSensor ERROR: Failed to wake up replay");
     }
 
-    switch (type) {
-        case ubuntu_sensor_type_light:
-            ss >> event_x;
-            //cout << "got event: sensor type " << type << " (light), delay "
-            //     << delay << " ms, value " << event_x << endl;
-            break;
+    scheduled_cv.notify_one();
+    return true;
+}
 
-        case ubuntu_sensor_type_accelerometer:
-            ss >> event_x >> event_y >> event_z;
-            //cout << "got event: sensor type " << type << " (accel), delay "
-            //     << delay << " ms, value " << event_x << "/" << event_y << "/" << event_z << endl;
-            break;
+// the queue whose next event is due first, or NULL if all are empty
+deque<ScheduledEvent>*
+SensorController::earliest()
+{
+    deque<ScheduledEvent>* first = NULL;
+    for (auto& stream : scheduled) {
+        if (stream.empty())
+            continue;
+        if (first == NULL || stream.front().time < first->front().time
+            || (stream.front().time == first->front().time && stream.front().sequence < first->front().sequence))
+            first = &stream;
+    }
 
-        case ubuntu_sensor_type_proximity:
-            ss >> token;
-            if (token == "unknown")
-                event_distance = (UASProximityDistance) 0;  // LP#1256969
-            else if (token == "near")
-                event_distance = U_PROXIMITY_NEAR;
-            else if (token == "far")
-                event_distance = U_PROXIMITY_FAR;
-            else {
-                cerr << "TestSensor ERROR: unknown proximity value " << token << endl;
-                abort();
-            }
-            //cout << "got event: sensor type " << type << " (proximity), delay "
-            //     << delay << " ms, value " << int(event_distance) << endl;
-            break;
+    return first;
+}
 
-        default:
-            cerr << "TestSensor ERROR: unhandled sensor type " << token << endl;
-            abort();
+// the sensor whose batching FIFO is due to be flushed first, or NULL if none
+// holds readings; time is set to the flush deadline on the replay timeline
+TestSensor*
+SensorController::next_flush(uint64_t& time)
+{
+    TestSensor* first = NULL;
+    time = UINT64_MAX;
+    for (auto& s : batching) {
+        TestSensor* sensor = __atomic_load_n(&s, __ATOMIC_ACQUIRE);
+        if (sensor == NULL)
+            continue;
+        const uint64_t deadline = sensor->flush_deadline();
+        if (deadline != UINT64_MAX && deadline - realtime_origin < time) {
+            time = deadline - realtime_origin;
+            first = sensor;
+        }
     }
 
-    // wake up after given delay for committing the change and processing the
-    // next event
-    setup_timer(unsigned(delay));
+    return first;
 }
 
+// replay thread: fire scheduled events and flush batching FIFOs when they are due
 void
-SensorController::setup_timer(unsigned delay_ms)
+SensorController::replay()
 {
-    static timer_t timerid; // we keep a pointer to that until on_timer
-    struct sigevent sev;
-    struct itimerspec its { {0, 0}, // interval
-                            {time_t(delay_ms / 1000),
-                             long((delay_ms % 1000) * 1000000L) % 1000000000L } };
+    for (;;) {
+        ScheduledEvent event;
+        {
+            unique_lock<mutex> lk(schedule_mtx);
+            waiting_for = UINT64_MAX;
+
+            // only this thread fills the FIFOs, so their deadlines cannot
+            // appear while it waits for new events
+            deque<ScheduledEvent>* stream;
+            TestSensor* flushing;
+            uint64_t time;
+            for (;;) {
+                stream = earliest();
+                flushing = next_flush(time);
+                if (stream != NULL && stream->front().time <= time) {
+                    flushing = NULL;
+                    time = stream->front().time;
+                }
+                if (exit || flushing != NULL || stream != NULL)
+                    break;
+                idle = true;
+                idle_cv.notify_all();
+                scheduled_cv.wait(lk);
+            }
+            if (exit)
+                return;
+
+            // sleep until it is due, or until an earlier event gets scheduled
+            uint64_t deadline = clock.due(time);
+            if (deadline > monotonic_now()) {
+                waiting_for = time;
+                idle = true;
+                idle_cv.notify_all();
+                lk.unlock();
+                if (!wait_until(deadline))
+                    return;
+                continue;
+            }
 
-    sev.sigev_notify = SIGEV_THREAD;
-    sev.sigev_notify_function = SensorController::on_timer;
-    sev.sigev_notify_attributes = NULL;
-    sev.sigev_value.sival_ptr = &timerid;
+            if (flushing != NULL) {
+                lk.unlock();
+                clock.advance(time);
+                flushing->flush();
+                continue;
+            }
 
-    if (timer_create(CLOCK_MONOTONIC, &sev, &timerid) < 0) {
-        perror("TestSensor ERROR: Failed to create timer");
-        abort();
+            event = stream->front();
+            if (!event.generated || !next_sample(stream->front()))
+                stream->pop_front();
+        }
+        space_cv.notify_one();
+
+        if (event.sensor == NULL) {
+            set_speed(event.speed);
+            continue;
+        }
+
+        clock.advance(event.time);
+        fire(event);
     }
-    if (timer_settime(timerid, 0, &its, NULL) < 0) {
+}
+
+// sleep until the given CLOCK_MONOTONIC time or a wakeup, returns false on shutdown;
+// UINT64_MAX only waits for a wakeup
+bool
+SensorController::wait_until(uint64_t deadline)
+{
+    struct itimerspec its { {0, 0}, {0, 0} };
+    if (deadline != UINT64_MAX)
+        its.it_value = {time_t(deadline / 1000000000ULL), long(deadline % 1000000000ULL)};
+
+    if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
         perror("TestSensor ERROR: Failed to set up timer");
         abort();
-    };
+    }
+
+    struct pollfd fds[3] = { { timer_fd, POLLIN, 0 }, { exit_fd, POLLIN, 0 }, { wakeup_fd, POLLIN, 0 } };
+    while (poll(fds, 3, -1) < 0 && errno == EINTR)
+        ;
+    if (fds[1].revents != 0)
+        return false;
+
+    uint64_t count;
+    if (fds[2].revents != 0 && read(wakeup_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+        perror("TestSensor ERROR: Failed to reset wakeup");
+    if (fds[0].revents != 0 && read(timer_fd, &count, sizeof(count)) < 0)
+        perror("TestSensor ERROR: Failed to read timer");
+
+    return true;
 }
 
 void
-SensorController::on_timer(union sigval sval)
+SensorController::set_speed(float speed)
+{
+    clock.set_speed(speed);
+    if (clock.is_virtual())
+        cout << "TestSensor INFO: Ignoring replay speed " << speed << " with virtual clock" << endl;
+    else if (speed == 0)
+        cout << "TestSensor INFO: Replaying events unthrottled" << endl;
+    else
+        cout << "TestSensor INFO: Replaying events at " << speed << "x speed" << endl;
+}
+
+bool
+SensorController::advance_clock(uint64_t duration, bool wait_for_input)
 {
-    timer_t* timerid = static_cast<timer_t*>(sval.sival_ptr);
-    //cout << "on_timer called\n";
-    timer_delete(*timerid);
+    if (!clock.is_virtual())
+        return false;
+
+    unique_lock<mutex> lk(schedule_mtx);
+    const uint64_t until = clock.release(duration);
+    idle = false;
+    waiting_for = UINT64_MAX;
+    static const uint64_t one = 1;
+    if (write(wakeup_fd, &one, sizeof(one)) < 0)
+        perror("TestSensor ERROR: Failed to wake up replay");
+    scheduled_cv.notify_one();
+
+    // the pipe may never deliver more commands, so only wait for data files
+    wait_for_input = wait_for_input && !dynamic;
+    idle_cv.wait(lk, [this, wait_for_input, until] {
+        return exit || (idle && (!wait_for_input || input_done || input_full || scheduled_until > until));
+    });
+    return true;
+}
 
-    SensorController& sc = SensorController::instance();
+// worker thread: no more commands or records will be scheduled
+void
+SensorController::finish_input()
+{
+    lock_guard<mutex> lk(schedule_mtx);
+    input_done = true;
+    idle_cv.notify_all();
+}
 
+void
+SensorController::fire(const ScheduledEvent& event)
+{
     // update sensor values, call callback
-    if (sc.event_sensor && sc.event_sensor->enabled) {
-        sc.event_sensor->x = sc.event_x;
-        sc.event_sensor->y = sc.event_y;
-        sc.event_sensor->z = sc.event_z;
-        sc.event_sensor->distance = sc.event_distance;
-        sc.event_sensor->timestamp = chrono::duration_cast<chrono::nanoseconds>(
-                chrono::system_clock::now().time_since_epoch()).count();
-        if (sc.event_sensor->on_event_cb != NULL) {
-            //cout << "TestSensor: calling sensor callback for type " << sc.event_sensor->type << endl;
-            sc.event_sensor->on_event_cb(sc.event_sensor, sc.event_sensor->event_cb_context);
-        } else {
-            //cout << "TestSensor: sensor type " << sc.event_sensor->type << "has no callback\n";
-        }
+    if (event.sensor->is_enabled()) {
+        TestReading r { realtime_origin + event.time, event.x, event.y, event.z, event.distance };
+        event.sensor->push_reading(r);
     } else {
-        //cout << "TestSensor: sensor type " << sc.event_sensor->type << "disabled, not processing event\n";
+        //cout << "TestSensor: sensor type " << event.sensor->type << "disabled, not processing event\n";
     }
 
-    // read/process next event
-    if (sc.dynamic) {
-        sc.block = false;
-        sc.comm_cv.notify_one();
+    // other processes subscribe independently of the local enable state
+    if (publisher) {
+        TestReading r { monotonic_origin + event.time, event.x, event.y, event.z, event.distance };
+        publish(*event.sensor, r);
+    }
+}
+
+void
+SensorController::describe(const TestSensor& sensor)
+{
+    if (!publisher)
+        return;
+
+    ubuntu::application::sensors::multiplexer::SensorDescription& d =
+        publisher->meta().sensors[sensor.type];
+
+    d.min_delay = sensor.min_delay;
+    d.min_value = sensor.min_value;
+    // proximity readings are reported as distance, with max_value meaning far
+    d.max_value = sensor.type == ubuntu_sensor_type_proximity ? 1.f : sensor.max_value;
+    d.resolution = sensor.resolution;
+    d.power_consumption = 0;
+    snprintf(d.name, sizeof(d.name), "Test %s", sensor_type_name(sensor.type));
+    snprintf(d.vendor, sizeof(d.vendor), "Ubuntu");
+    __atomic_store_n(&d.present, 1, __ATOMIC_RELEASE);
+}
+
+void
+SensorController::publish(const TestSensor& sensor, const TestReading& r)
+{
+    ubuntu::application::sensors::multiplexer::Reading reading;
+    reading.timestamp = r.timestamp;
+    reading.type = sensor.type;
+
+    if (sensor.type == ubuntu_sensor_type_proximity) {
+        reading.values[0] = r.distance == U_PROXIMITY_FAR ? 1.f : 0.f;
+        reading.values[1] = reading.values[2] = 0.f;
     } else {
-        if (sc.next_command())
-            sc.process_event_command();
-        else {
-            //cout << "TestSensor: script ended, no further commands\n";
-        }
+        reading.values[0] = r.x;
+        reading.values[1] = r.y;
+        reading.values[2] = r.z;
     }
+
+    publisher->publish(reading);
+    publisher->notify();
 }
 
 
@@ -508,18 +1499,18 @@ SensorController::on_timer(union sigval sval)
 
 UASensorsAccelerometer* ua_sensors_accelerometer_new()
 {
-    return SensorController::instance().get(ubuntu_sensor_type_accelerometer);
+    return SensorController::current().get(ubuntu_sensor_type_accelerometer);
 }
 
 UStatus ua_sensors_accelerometer_enable(UASensorsAccelerometer* s)
 {
-    static_cast<TestSensor*>(s)->enabled = true;
+    static_cast<TestSensor*>(s)->set_enabled(true);
     return (UStatus) 0;
 }
 
 UStatus ua_sensors_accelerometer_disable(UASensorsAccelerometer* s)
 {
-    static_cast<TestSensor*>(s)->enabled = false;
+    static_cast<TestSensor*>(s)->set_enabled(false);
     return (UStatus) 0;
 }
 
@@ -563,16 +1554,25 @@ UStatus ua_sensors_accelerometer_set_event_rate(UASensorsAccelerometer* s, uint3
     return U_STATUS_SUCCESS;
 }
 
+UStatus ua_sensors_accelerometer_set_batching(UASensorsAccelerometer* s, uint64_t period, uint64_t max_latency)
+{
+    static_cast<TestSensor*>(s)->set_batching(period, max_latency);
+    return U_STATUS_SUCCESS;
+}
+
 void ua_sensors_accelerometer_set_reading_cb(UASensorsAccelerometer* s, on_accelerometer_event_cb cb, void* ctx)
 {
-    TestSensor* sensor = static_cast<TestSensor*>(s);
-    sensor->on_event_cb = cb;
-    sensor->event_cb_context = ctx;
+    static_cast<TestSensor*>(s)->set_reading_cb(cb, ctx);
+}
+
+void ua_sensors_accelerometer_set_batch_reading_cb(UASensorsAccelerometer* s, on_accelerometer_batch_cb cb, void* ctx)
+{
+    static_cast<TestSensor*>(s)->set_batch_reading_cb(cb, ctx);
 }
 
 uint64_t uas_accelerometer_event_get_timestamp(UASAccelerometerEvent* e)
 {
-    return static_cast<TestSensor*>(e)->timestamp;
+    return static_cast<TestSensor*>(e)->current.load().timestamp;
 }
 
 UStatus uas_accelerometer_event_get_acceleration_x(UASAccelerometerEvent* e, float* value)
@@ -580,7 +1580,7 @@ UStatus uas_accelerometer_event_get_acceleration_x(UASAccelerometerEvent* e, flo
     if (!value)
         return U_STATUS_ERROR;
 
-    *value = static_cast<TestSensor*>(e)->x;
+    *value = static_cast<TestSensor*>(e)->current.load().x;
 
     return U_STATUS_SUCCESS;
 }
@@ -590,7 +1590,7 @@ UStatus uas_accelerometer_event_get_acceleration_y(UASAccelerometerEvent* e, flo
     if (!value)
         return U_STATUS_ERROR;
 
-    *value = static_cast<TestSensor*>(e)->y;
+    *value = static_cast<TestSensor*>(e)->current.load().y;
 
     return U_STATUS_SUCCESS;
 }
@@ -600,7 +1600,7 @@ UStatus uas_accelerometer_event_get_acceleration_z(UASAccelerometerEvent* e, flo
     if (!value)
         return U_STATUS_ERROR;
 
-    *value = static_cast<TestSensor*>(e)->z;
+    *value = static_cast<TestSensor*>(e)->current.load().z;
 
     return U_STATUS_SUCCESS;
 }
@@ -613,18 +1613,18 @@ UStatus uas_accelerometer_event_get_acceleration_z(UASAccelerometerEvent* e, flo
 
 UASensorsProximity* ua_sensors_proximity_new()
 {
-    return SensorController::instance().get(ubuntu_sensor_type_proximity);
+    return SensorController::current().get(ubuntu_sensor_type_proximity);
 }
 
 UStatus ua_sensors_proximity_enable(UASensorsProximity* s)
 {
-    static_cast<TestSensor*>(s)->enabled = true;
+    static_cast<TestSensor*>(s)->set_enabled(true);
     return (UStatus) 0;
 }
 
 UStatus ua_sensors_proximity_disable(UASensorsProximity* s)
 {
-    static_cast<TestSensor*>(s)->enabled = false;
+    static_cast<TestSensor*>(s)->set_enabled(false);
     return (UStatus) 0;
 }
 
@@ -669,21 +1669,25 @@ UStatus ua_sensors_proximity_set_event_rate(UASensorsProximity* s, uint32_t rate
     return U_STATUS_SUCCESS;
 }
 
+UStatus ua_sensors_proximity_set_batching(UASensorsProximity* s, uint64_t period, uint64_t max_latency)
+{
+    static_cast<TestSensor*>(s)->set_batching(period, max_latency);
+    return U_STATUS_SUCCESS;
+}
+
 void ua_sensors_proximity_set_reading_cb(UASensorsProximity* s, on_proximity_event_cb cb, void* ctx)
 {
-    TestSensor* sensor = static_cast<TestSensor*>(s);
-    sensor->on_event_cb = cb;
-    sensor->event_cb_context = ctx;
+    static_cast<TestSensor*>(s)->set_reading_cb(cb, ctx);
 }
 
 uint64_t uas_proximity_event_get_timestamp(UASProximityEvent* e)
 {
-    return static_cast<TestSensor*>(e)->timestamp;
+    return static_cast<TestSensor*>(e)->current.load().timestamp;
 }
 
 UASProximityDistance uas_proximity_event_get_distance(UASProximityEvent* e)
 {
-    return static_cast<TestSensor*>(e)->distance;
+    return static_cast<TestSensor*>(e)->current.load().distance;
 }
 
 
@@ -695,18 +1699,18 @@ UASProximityDistance uas_proximity_event_get_distance(UASProximityEvent* e)
 
 UASensorsLight* ua_sensors_light_new()
 {
-    return SensorController::instance().get(ubuntu_sensor_type_light);
+    return SensorController::current().get(ubuntu_sensor_type_light);
 }
 
 UStatus ua_sensors_light_enable(UASensorsLight* s)
 {
-    static_cast<TestSensor*>(s)->enabled = true;
+    static_cast<TestSensor*>(s)->set_enabled(true);
     return (UStatus) 0;
 }
 
 UStatus ua_sensors_light_disable(UASensorsLight* s)
 {
-    static_cast<TestSensor*>(s)->enabled = false;
+    static_cast<TestSensor*>(s)->set_enabled(false);
     return (UStatus) 0;
 }
 
@@ -750,16 +1754,20 @@ UStatus ua_sensors_light_set_event_rate(UASensorsLight* s, uint32_t rate)
     return U_STATUS_SUCCESS;
 }
 
+UStatus ua_sensors_light_set_batching(UASensorsLight* s, uint64_t period, uint64_t max_latency)
+{
+    static_cast<TestSensor*>(s)->set_batching(period, max_latency);
+    return U_STATUS_SUCCESS;
+}
+
 void ua_sensors_light_set_reading_cb(UASensorsLight* s, on_light_event_cb cb, void* ctx)
 {
-    TestSensor* sensor = static_cast<TestSensor*>(s);
-    sensor->on_event_cb = cb;
-    sensor->event_cb_context = ctx;
+    static_cast<TestSensor*>(s)->set_reading_cb(cb, ctx);
 }
 
 uint64_t uas_light_event_get_timestamp(UASLightEvent* e)
 {
-    return static_cast<TestSensor*>(e)->timestamp;
+    return static_cast<TestSensor*>(e)->current.load().timestamp;
 }
 
 UStatus uas_light_event_get_light(UASLightEvent* e, float* value)
@@ -767,57 +1775,65 @@ UStatus uas_light_event_get_light(UASLightEvent* e, float* value)
     if (!value)
         return U_STATUS_ERROR;
 
-    *value = static_cast<TestSensor*>(e)->x;
+    *value = static_cast<TestSensor*>(e)->current.load().x;
 
     return U_STATUS_SUCCESS;
 }
 
+/***************************************
+ *
+ * Orientation API
+ *
+ ***************************************/
+
 UASensorsOrientation* ua_sensors_orientation_new()
 {
-    return NULL;
+    return SensorController::current().get(ubuntu_sensor_type_orientation);
 }
 
-UStatus ua_sensors_orientation_enable(UASensorsOrientation*)
+UStatus ua_sensors_orientation_enable(UASensorsOrientation* s)
 {
+    static_cast<TestSensor*>(s)->set_enabled(true);
     return (UStatus) 0;
 }
 
-UStatus ua_sensors_orientation_disable(UASensorsOrientation*)
+UStatus ua_sensors_orientation_disable(UASensorsOrientation* s)
 {
+    static_cast<TestSensor*>(s)->set_enabled(false);
     return (UStatus) 0;
 }
 
-uint32_t ua_sensors_orientation_get_min_delay(UASensorsOrientation*)
+uint32_t ua_sensors_orientation_get_min_delay(UASensorsOrientation* s)
 {
-    return 0;
+    return static_cast<TestSensor*>(s)->min_delay;
 }
 
-UStatus ua_sensors_orientation_get_min_value(UASensorsOrientation*, float* value)
+UStatus ua_sensors_orientation_get_min_value(UASensorsOrientation* s, float* value)
 {
     if (!value)
         return U_STATUS_ERROR;
 
-    *value = 0.f;
+    *value = static_cast<TestSensor*>(s)->min_value;
 
     return U_STATUS_SUCCESS;
 }
 
-UStatus ua_sensors_orientation_get_max_value(UASensorsOrientation*, float* value)
+UStatus ua_sensors_orientation_get_max_value(UASensorsOrientation* s, float* value)
 {
     if (!value)
         return U_STATUS_ERROR;
 
-    *value = 0.f;
+    *value = static_cast<TestSensor*>(s)->max_value;
 
     return U_STATUS_SUCCESS;
 }
 
-UStatus ua_sensors_orientation_get_resolution(UASensorsOrientation*, float* value)
+UStatus ua_sensors_orientation_get_resolution(UASensorsOrientation* s, float* value)
 {
     if (!value)
         return U_STATUS_ERROR;
 
-    *value = 0.f;
+    *value = static_cast<TestSensor*>(s)->resolution;
 
     return U_STATUS_SUCCESS;
 }
@@ -827,41 +1843,176 @@ UStatus ua_sensors_orientation_set_event_rate(UASensorsOrientation* s, uint32_t
     return U_STATUS_SUCCESS;
 }
 
-void ua_sensors_orientation_set_reading_cb(UASensorsOrientation*, on_orientation_event_cb, void*)
+UStatus ua_sensors_orientation_set_batching(UASensorsOrientation* s, uint64_t period, uint64_t max_latency)
+{
+    static_cast<TestSensor*>(s)->set_batching(period, max_latency);
+    return U_STATUS_SUCCESS;
+}
+
+void ua_sensors_orientation_set_reading_cb(UASensorsOrientation* s, on_orientation_event_cb cb, void* ctx)
+{
+    static_cast<TestSensor*>(s)->set_reading_cb(cb, ctx);
+}
+
+void ua_sensors_orientation_set_batch_reading_cb(UASensorsOrientation* s, on_orientation_batch_cb cb, void* ctx)
 {
+    static_cast<TestSensor*>(s)->set_batch_reading_cb(cb, ctx);
 }
 
-uint64_t uas_orientation_event_get_timestamp(UASOrientationEvent*)
+uint64_t uas_orientation_event_get_timestamp(UASOrientationEvent* e)
 {
-    return 0;
+    return static_cast<TestSensor*>(e)->current.load().timestamp;
 }
 
-UStatus uas_orientation_event_get_azimuth(UASOrientationEvent*, float* value)
+UStatus uas_orientation_event_get_azimuth(UASOrientationEvent* e, float* value)
 {
     if (!value)
         return U_STATUS_ERROR;
 
-    *value = 0.f;
+    *value = static_cast<TestSensor*>(e)->current.load().x;
 
     return U_STATUS_SUCCESS;
 }
 
-UStatus uas_orientation_event_get_pitch(UASOrientationEvent*, float* value)
+UStatus uas_orientation_event_get_pitch(UASOrientationEvent* e, float* value)
 {
     if (!value)
         return U_STATUS_ERROR;
 
-    *value = 0.f;
+    *value = static_cast<TestSensor*>(e)->current.load().y;
 
     return U_STATUS_SUCCESS;
 }
 
-UStatus uas_orientation_event_get_roll(UASOrientationEvent*, float* value)
+UStatus uas_orientation_event_get_roll(UASOrientationEvent* e, float* value)
 {
     if (!value)
         return U_STATUS_ERROR;
 
-    *value = 0.f;
+    *value = static_cast<TestSensor*>(e)->current.load().z;
 
     return U_STATUS_SUCCESS;
 }
+
+
+/***************************************
+ *
+ * Deferred delivery API
+ *
+ ***************************************/
+
+UStatus ua_sensors_set_delivery_mode(void* s, UASensorsDeliveryMode mode)
+{
+    if (!s)
+        return U_STATUS_ERROR;
+
+    return static_cast<TestSensor*>(s)->set_delivery_mode(mode);
+}
+
+int ua_sensors_get_delivery_fd(void* s)
+{
+    TestSensor* sensor = static_cast<TestSensor*>(s);
+    if (!sensor || sensor->delivery_mode != U_SENSORS_DELIVERY_DEFERRED)
+        return -1;
+
+    return sensor->delivery_fd;
+}
+
+uint32_t ua_sensors_dispatch_pending(void* s)
+{
+    if (!s)
+        return 0;
+
+    return static_cast<TestSensor*>(s)->dispatch_pending();
+}
+
+uint64_t ua_sensors_get_dropped_readings(void* s)
+{
+    if (!s)
+        return 0;
+
+    return static_cast<TestSensor*>(s)->statistics.dropped();
+}
+
+
+/***************************************
+ *
+ * Decimation API
+ *
+ ***************************************/
+
+UStatus ua_sensors_set_decimation(void* s, uint64_t interval, UASensorsFilter filter, float cutoff)
+{
+    if (!s)
+        return U_STATUS_ERROR;
+
+    return static_cast<TestSensor*>(s)->set_decimation(interval, filter, cutoff);
+}
+
+
+/***************************************
+ *
+ * Statistics API
+ *
+ ***************************************/
+
+UStatus ua_sensors_get_stats(void* s, UASensorsStats* stats)
+{
+    if (!s || !stats)
+        return U_STATUS_ERROR;
+
+    static_cast<TestSensor*>(s)->statistics.snapshot(stats);
+    return U_STATUS_SUCCESS;
+}
+
+
+/***************************************
+ *
+ * Simulation context API
+ *
+ ***************************************/
+
+UASensorsTestContext* ua_sensors_test_context_new(const char* data_file)
+{
+    return ua_sensors_test_context_new_with_clock(data_file, U_SENSORS_TEST_CLOCK_DEFAULT);
+}
+
+UASensorsTestContext* ua_sensors_test_context_new_with_clock(const char* data_file, UASensorsTestClock clock)
+{
+    if (clock != U_SENSORS_TEST_CLOCK_DEFAULT && clock != U_SENSORS_TEST_CLOCK_REAL
+        && clock != U_SENSORS_TEST_CLOCK_VIRTUAL)
+        return NULL;
+
+    SensorController* controller = new SensorController(data_file, false, clock);
+    if (!controller->valid()) {
+        delete controller;
+        return NULL;
+    }
+
+    return controller;
+}
+
+void ua_sensors_test_context_destroy(UASensorsTestContext* c)
+{
+    delete static_cast<SensorController*>(c);
+}
+
+UStatus ua_sensors_test_context_make_current(UASensorsTestContext* c)
+{
+    SensorController::make_current(static_cast<SensorController*>(c));
+    return U_STATUS_SUCCESS;
+}
+
+const char* ua_sensors_test_context_get_fifo_path(UASensorsTestContext* c)
+{
+    if (!c)
+        return NULL;
+
+    return static_cast<SensorController*>(c)->fifo();
+}
+
+UStatus ua_sensors_test_context_advance_clock(UASensorsTestContext* c, uint64_t duration)
+{
+    SensorController& controller = c ? *static_cast<SensorController*>(c) : SensorController::instance();
+    return controller.advance_clock(duration, true) ? U_STATUS_SUCCESS : U_STATUS_ERROR;
+}
@@ -42,6 +42,19 @@ struct HIDDEN_SYMBOL ToHybris
         return cache;
     }
 
+    /* Routes are not supported, everything is served by the one library
+     * above: there are none, and module_path() reports that it cannot serve
+     * the module. */
+    static const char* routes()
+    {
+        return NULL;
+    }
+
+    static const char* module_path(const char* module)
+    {
+        return NULL;
+    }
+
     static const char* override_path()
     {
         return NULL;
@@ -52,6 +65,12 @@ struct HIDDEN_SYMBOL ToHybris
         return android_dlopen(path, flags);
     }
 
+    // never called, see routes()
+    static void* dlopen_route_fn(const char* path, int flags)
+    {
+        return NULL;
+    }
+
     static void* dlsym_fn(void* handle, const char* symbol)
     {
         return android_dlsym(handle, symbol);
@@ -59,7 +78,7 @@ struct HIDDEN_SYMBOL ToHybris
 };
 }
 
-#define DLSYM(fptr, sym) if (*(fptr) == NULL) { *((void**)fptr) = (void *) internal::Bridge<internal::ToHybris>::instance().resolve_symbol(sym); }
+#define DLSYM(fptr, sym) internal::bind_symbol<internal::ToHybris>(fptr, sym)
 
 #include <hybris_bridge_defs.h>
 
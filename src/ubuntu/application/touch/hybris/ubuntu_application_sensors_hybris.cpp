@@ -21,6 +21,10 @@
 #include <ubuntu/application/sensors/proximity.h>
 #include <ubuntu/application/sensors/light.h>
 #include <ubuntu/application/sensors/orientation.h>
+#include <ubuntu/application/sensors/delivery.h>
+#include <ubuntu/application/sensors/decimation.h>
+#include <ubuntu/application/sensors/stats.h>
+#include <ubuntu/application/sensors/test_context.h>
 
 #include "hybris_module.h"
 
@@ -36,6 +40,8 @@ IMPLEMENT_FUNCTION2(UStatus, ua_sensors_accelerometer_get_max_value, UASensorsAc
 IMPLEMENT_FUNCTION2(UStatus, ua_sensors_accelerometer_get_resolution, UASensorsAccelerometer*, float*);
 IMPLEMENT_VOID_FUNCTION3(ua_sensors_accelerometer_set_reading_cb, UASensorsAccelerometer*, on_accelerometer_event_cb, void*);
 IMPLEMENT_FUNCTION2(UStatus, ua_sensors_accelerometer_set_event_rate, UASensorsAccelerometer*, uint32_t);
+IMPLEMENT_FUNCTION3(UStatus, ua_sensors_accelerometer_set_batching, UASensorsAccelerometer*, uint64_t, uint64_t);
+IMPLEMENT_VOID_FUNCTION3(ua_sensors_accelerometer_set_batch_reading_cb, UASensorsAccelerometer*, on_accelerometer_batch_cb, void*);
 
 // Acceleration Sensor Event
 IMPLEMENT_FUNCTION1(uint64_t, uas_accelerometer_event_get_timestamp, UASAccelerometerEvent*);
@@ -53,6 +59,7 @@ IMPLEMENT_FUNCTION2(UStatus, ua_sensors_proximity_get_max_value, UASensorsProxim
 IMPLEMENT_FUNCTION2(UStatus, ua_sensors_proximity_get_resolution, UASensorsProximity*, float*);
 IMPLEMENT_VOID_FUNCTION3(ua_sensors_proximity_set_reading_cb, UASensorsProximity*, on_proximity_event_cb, void*);
 IMPLEMENT_FUNCTION2(UStatus, ua_sensors_proximity_set_event_rate, UASensorsProximity*, uint32_t);
+IMPLEMENT_FUNCTION3(UStatus, ua_sensors_proximity_set_batching, UASensorsProximity*, uint64_t, uint64_t);
 
 // Proximity Sensor Event
 IMPLEMENT_FUNCTION1(uint64_t, uas_proximity_event_get_timestamp, UASProximityEvent*);
@@ -68,6 +75,7 @@ IMPLEMENT_FUNCTION2(UStatus, ua_sensors_light_get_max_value, UASensorsLight*, fl
 IMPLEMENT_FUNCTION2(UStatus, ua_sensors_light_get_resolution, UASensorsLight*, float*);
 IMPLEMENT_VOID_FUNCTION3(ua_sensors_light_set_reading_cb, UASensorsLight*, on_light_event_cb, void*);
 IMPLEMENT_FUNCTION2(UStatus, ua_sensors_light_set_event_rate, UASensorsLight*, uint32_t);
+IMPLEMENT_FUNCTION3(UStatus, ua_sensors_light_set_batching, UASensorsLight*, uint64_t, uint64_t);
 
 // Ambient Light Sensor Event
 IMPLEMENT_FUNCTION1(uint64_t, uas_light_event_get_timestamp, UASLightEvent*);
@@ -83,9 +91,31 @@ IMPLEMENT_FUNCTION2(UStatus, ua_sensors_orientation_get_max_value, UASensorsOrie
 IMPLEMENT_FUNCTION2(UStatus, ua_sensors_orientation_get_resolution, UASensorsOrientation*, float*);
 IMPLEMENT_VOID_FUNCTION3(ua_sensors_orientation_set_reading_cb, UASensorsOrientation*, on_orientation_event_cb, void*);
 IMPLEMENT_FUNCTION2(UStatus, ua_sensors_orientation_set_event_rate, UASensorsOrientation*, uint32_t);
+IMPLEMENT_FUNCTION3(UStatus, ua_sensors_orientation_set_batching, UASensorsOrientation*, uint64_t, uint64_t);
+IMPLEMENT_VOID_FUNCTION3(ua_sensors_orientation_set_batch_reading_cb, UASensorsOrientation*, on_orientation_batch_cb, void*);
 
 // Orientation Sensor Event
 IMPLEMENT_FUNCTION1(uint64_t, uas_orientation_event_get_timestamp, UASOrientationEvent*);
 IMPLEMENT_FUNCTION2(UStatus, uas_orientation_event_get_azimuth, UASOrientationEvent*, float*);
 IMPLEMENT_FUNCTION2(UStatus, uas_orientation_event_get_pitch, UASOrientationEvent*, float*);
 IMPLEMENT_FUNCTION2(UStatus, uas_orientation_event_get_roll, UASOrientationEvent*, float*);
+
+// Deferred delivery of sensor readings
+IMPLEMENT_FUNCTION2(UStatus, ua_sensors_set_delivery_mode, void*, UASensorsDeliveryMode);
+IMPLEMENT_FUNCTION1(int, ua_sensors_get_delivery_fd, void*);
+IMPLEMENT_FUNCTION1(uint32_t, ua_sensors_dispatch_pending, void*);
+IMPLEMENT_FUNCTION1(uint64_t, ua_sensors_get_dropped_readings, void*);
+
+// Per-process decimation of sensor readings
+IMPLEMENT_FUNCTION4(UStatus, ua_sensors_set_decimation, void*, uint64_t, UASensorsFilter, float);
+
+// Instrumentation
+IMPLEMENT_FUNCTION2(UStatus, ua_sensors_get_stats, void*, UASensorsStats*);
+
+// Simulation contexts of the test backend
+IMPLEMENT_FUNCTION1(UASensorsTestContext*, ua_sensors_test_context_new, const char*);
+IMPLEMENT_FUNCTION2(UASensorsTestContext*, ua_sensors_test_context_new_with_clock, const char*, UASensorsTestClock);
+IMPLEMENT_VOID_FUNCTION1(ua_sensors_test_context_destroy, UASensorsTestContext*);
+IMPLEMENT_FUNCTION1(UStatus, ua_sensors_test_context_make_current, UASensorsTestContext*);
+IMPLEMENT_FUNCTION1(const char*, ua_sensors_test_context_get_fifo_path, UASensorsTestContext*);
+IMPLEMENT_FUNCTION2(UStatus, ua_sensors_test_context_advance_clock, UASensorsTestContext*, uint64_t);
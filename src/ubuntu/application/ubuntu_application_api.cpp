@@ -28,6 +28,10 @@
 #include <ubuntu/application/sensors/light.h>
 #include <ubuntu/application/sensors/orientation.h>
 #include <ubuntu/application/sensors/haptic.h>
+#include <ubuntu/application/sensors/delivery.h>
+#include <ubuntu/application/sensors/decimation.h>
+#include <ubuntu/application/sensors/stats.h>
+#include <ubuntu/application/sensors/test_context.h>
 
 #include <ubuntu/application/location/service.h>
 #include <ubuntu/application/location/heading_update.h>
@@ -49,6 +53,57 @@ IMPLEMENT_VOID_FUNCTION3(init, u_application_module_version, uint32_t*, uint32_t
 IMPLEMENT_VOID_FUNCTION1(init, u_application_init, void*);
 IMPLEMENT_VOID_FUNCTION0(init, u_application_finish);
 
+// Answered by the bridge itself
+size_t u_application_list_overridden_modules(const char** modules, size_t count)
+{
+    return internal::Bridge<internal::ToBackend>::instance().list_overrides(modules, count);
+}
+
+static uint64_t timed_bind_table()
+{
+    typedef internal::Bridge<internal::ToBackend> Bridge;
+
+    // Backends are loaded while binding the modules they serve, which is
+    // accounted for by the bridge itself
+    Bridge& bridge = Bridge::instance();
+    const uint64_t loading = bridge.path_time() + bridge.load_time();
+    const uint64_t start = Bridge::monotonic_ns();
+    bridge_bind_table();
+    const uint64_t elapsed = Bridge::monotonic_ns() - start;
+
+    return elapsed - (bridge.path_time() + bridge.load_time() - loading);
+}
+
+void u_application_preload_backend(UApplicationPreloadTimes* times)
+{
+    // Resolve everything now instead of on the first call of each function
+    internal::Bridge<internal::ToBackend>& bridge = internal::Bridge<internal::ToBackend>::instance(RTLD_NOW);
+    static const bool resolved_now = bridge.resolve_now();
+    static const uint64_t bind_time = timed_bind_table();
+
+    if (times == NULL)
+        return;
+
+    times->config_time = bridge.path_time();
+    times->load_time = bridge.load_time();
+    times->bind_time = bind_time;
+    times->resolved_now = resolved_now;
+}
+
+// $UBUNTU_PLATFORM_API_PRELOAD moves loading the backend from the first call to library load time
+__attribute__ ((constructor)) static void preload_backend_on_load()
+{
+    const char* preload = secure_getenv("UBUNTU_PLATFORM_API_PRELOAD");
+    if (preload == NULL || *preload == '\0')
+        return;
+
+    UApplicationPreloadTimes times;
+    u_application_preload_backend(&times);
+
+    fprintf(stderr, "Platform API: INFO: Preloaded backend (config %.3f ms, load %.3f ms, bind %.3f ms)\n",
+            times.config_time * 1e-6, times.load_time * 1e-6, times.bind_time * 1e-6);
+}
+
 // Lifecycle helpers
 IMPLEMENT_CTOR0(lifecycle, UApplicationLifecycleDelegate*, u_application_lifecycle_delegate_new);
 IMPLEMENT_VOID_FUNCTION2(lifecycle, u_application_lifecycle_delegate_set_context, UApplicationLifecycleDelegate*, void*);
@@ -90,6 +145,8 @@ IMPLEMENT_FUNCTION2(sensors, UStatus, ua_sensors_accelerometer_get_max_value, UA
 IMPLEMENT_FUNCTION2(sensors, UStatus, ua_sensors_accelerometer_get_resolution, UASensorsAccelerometer*, float*);
 IMPLEMENT_VOID_FUNCTION3(sensors, ua_sensors_accelerometer_set_reading_cb, UASensorsAccelerometer*, on_accelerometer_event_cb, void*);
 IMPLEMENT_FUNCTION2(sensors, UStatus, ua_sensors_accelerometer_set_event_rate, UASensorsAccelerometer*, uint32_t);
+IMPLEMENT_FUNCTION3(sensors, UStatus, ua_sensors_accelerometer_set_batching, UASensorsAccelerometer*, uint64_t, uint64_t);
+IMPLEMENT_VOID_FUNCTION3(sensors, ua_sensors_accelerometer_set_batch_reading_cb, UASensorsAccelerometer*, on_accelerometer_batch_cb, void*);
 
 // Acceleration Sensor Event
 IMPLEMENT_FUNCTION1(sensors, uint64_t, uas_accelerometer_event_get_timestamp, UASAccelerometerEvent*);
@@ -107,6 +164,7 @@ IMPLEMENT_FUNCTION2(sensors, UStatus, ua_sensors_proximity_get_max_value, UASens
 IMPLEMENT_FUNCTION2(sensors, UStatus, ua_sensors_proximity_get_resolution, UASensorsProximity*, float*);
 IMPLEMENT_VOID_FUNCTION3(sensors, ua_sensors_proximity_set_reading_cb, UASensorsProximity*, on_proximity_event_cb, void*);
 IMPLEMENT_FUNCTION2(sensors, UStatus, ua_sensors_proximity_set_event_rate, UASensorsProximity*, uint32_t);
+IMPLEMENT_FUNCTION3(sensors, UStatus, ua_sensors_proximity_set_batching, UASensorsProximity*, uint64_t, uint64_t);
 
 // Proximity Sensor Event
 IMPLEMENT_FUNCTION1(sensors, uint64_t, uas_proximity_event_get_timestamp, UASProximityEvent*);
@@ -122,6 +180,7 @@ IMPLEMENT_FUNCTION2(sensors, UStatus, ua_sensors_light_get_max_value, UASensorsL
 IMPLEMENT_FUNCTION2(sensors, UStatus, ua_sensors_light_get_resolution, UASensorsLight*, float*);
 IMPLEMENT_VOID_FUNCTION3(sensors, ua_sensors_light_set_reading_cb, UASensorsLight*, on_light_event_cb, void*);
 IMPLEMENT_FUNCTION2(sensors, UStatus, ua_sensors_light_set_event_rate, UASensorsLight*, uint32_t);
+IMPLEMENT_FUNCTION3(sensors, UStatus, ua_sensors_light_set_batching, UASensorsLight*, uint64_t, uint64_t);
 
 // Ambient Light Sensor Event
 IMPLEMENT_FUNCTION1(sensors, uint64_t, uas_light_event_get_timestamp, UASLightEvent*);
@@ -145,6 +204,8 @@ IMPLEMENT_FUNCTION2(sensors, UStatus, ua_sensors_orientation_get_max_value, UASe
 IMPLEMENT_FUNCTION2(sensors, UStatus, ua_sensors_orientation_get_resolution, UASensorsOrientation*, float*);
 IMPLEMENT_VOID_FUNCTION3(sensors, ua_sensors_orientation_set_reading_cb, UASensorsOrientation*, on_orientation_event_cb, void*);
 IMPLEMENT_FUNCTION2(sensors, UStatus, ua_sensors_orientation_set_event_rate, UASensorsOrientation*, uint32_t);
+IMPLEMENT_FUNCTION3(sensors, UStatus, ua_sensors_orientation_set_batching, UASensorsOrientation*, uint64_t, uint64_t);
+IMPLEMENT_VOID_FUNCTION3(sensors, ua_sensors_orientation_set_batch_reading_cb, UASensorsOrientation*, on_orientation_batch_cb, void*);
 
 // Orientation Sensor Event
 IMPLEMENT_FUNCTION1(sensors, uint64_t, uas_orientation_event_get_timestamp, UASOrientationEvent*);
@@ -152,6 +213,26 @@ IMPLEMENT_FUNCTION2(sensors, UStatus, uas_orientation_event_get_azimuth, UASOrie
 IMPLEMENT_FUNCTION2(sensors, UStatus, uas_orientation_event_get_pitch, UASOrientationEvent*, float*);
 IMPLEMENT_FUNCTION2(sensors, UStatus, uas_orientation_event_get_roll, UASOrientationEvent*, float*);
 
+// Deferred delivery of sensor readings
+IMPLEMENT_FUNCTION2(sensors, UStatus, ua_sensors_set_delivery_mode, void*, UASensorsDeliveryMode);
+IMPLEMENT_FUNCTION1(sensors, int, ua_sensors_get_delivery_fd, void*);
+IMPLEMENT_FUNCTION1(sensors, uint32_t, ua_sensors_dispatch_pending, void*);
+IMPLEMENT_FUNCTION1(sensors, uint64_t, ua_sensors_get_dropped_readings, void*);
+
+// Per-process decimation of sensor readings
+IMPLEMENT_FUNCTION4(sensors, UStatus, ua_sensors_set_decimation, void*, uint64_t, UASensorsFilter, float);
+
+// Instrumentation
+IMPLEMENT_FUNCTION2(sensors, UStatus, ua_sensors_get_stats, void*, UASensorsStats*);
+
+// Simulation contexts of the test backend
+IMPLEMENT_FUNCTION1(sensors, UASensorsTestContext*, ua_sensors_test_context_new, const char*);
+IMPLEMENT_FUNCTION2(sensors, UASensorsTestContext*, ua_sensors_test_context_new_with_clock, const char*, UASensorsTestClock);
+IMPLEMENT_VOID_FUNCTION1(sensors, ua_sensors_test_context_destroy, UASensorsTestContext*);
+IMPLEMENT_FUNCTION1(sensors, UStatus, ua_sensors_test_context_make_current, UASensorsTestContext*);
+IMPLEMENT_FUNCTION1(sensors, const char*, ua_sensors_test_context_get_fifo_path, UASensorsTestContext*);
+IMPLEMENT_FUNCTION2(sensors, UStatus, ua_sensors_test_context_advance_clock, UASensorsTestContext*, uint64_t);
+
 // Location
 
 IMPLEMENT_VOID_FUNCTION1(location, ua_location_service_controller_ref, UALocationServiceController*);
@@ -16,22 +16,45 @@
  * Authored by: Martin Pitt <martin.pitti@ubuntu.com>
  */
 
+#include <cmath>
+#include <cstddef>
 #include <cstdlib>
 #include <cstdio>
+#include <cstring>
 #include <queue>
 #include <chrono>
 #include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/wait.h>
 
 #include <core/testing/fork_and_run.h>
 
 #include "gtest/gtest.h"
 
+#include <ubuntu/application/init.h>
+#include <ubuntu/application/lifecycle_delegate.h>
 #include <ubuntu/application/sensors/accelerometer.h>
 #include <ubuntu/application/sensors/event/accelerometer.h>
 #include <ubuntu/application/sensors/proximity.h>
 #include <ubuntu/application/sensors/event/proximity.h>
 #include <ubuntu/application/sensors/light.h>
 #include <ubuntu/application/sensors/event/light.h>
+#include <ubuntu/application/sensors/orientation.h>
+#include <ubuntu/application/sensors/event/orientation.h>
+#include <ubuntu/application/sensors/delivery.h>
+#include <ubuntu/application/sensors/decimation.h>
+#include <ubuntu/application/sensors/stats.h>
+#include <ubuntu/application/sensors/test_context.h>
+
+#include <private/application/sensors/multiplexer.h>
+#include <private/application/sensors/sensor_trace.h>
 
 using namespace std;
 
@@ -79,7 +102,12 @@ class SimBackendTest : public testing::Test
 
     void set_data(const char* data)
     {
-        write(data_fd, data, strlen(data));
+        set_data(data, strlen(data));
+    }
+
+    void set_data(const void* data, size_t size)
+    {
+        write(data_fd, data, size);
         fsync(data_fd);
     }
 
@@ -228,6 +256,88 @@ TESTP_F(SimBackendTest, LightEvents, {
     EXPECT_LE(delay, 112);
 })
 
+TESTP_F(SimBackendTest, OrientationEvents, {
+    // the other sensors only feed the multiplexer, but are created and replayed
+    set_data("create orientation 0 360 0.1\n"
+             "create gyro -35 35 0.01\n"
+             "create magnetic -2000 2000 0.5\n"
+             "create rotation_vector -1 1 0.001\n"
+             "10 gyro 0.1 -0.2 0.3\n"
+             "10 orientation 270 -45.5 10\n"
+             "10 magnetic 20 -5 -40\n"
+             "10 rotation_vector 0 0 0.7071\n"
+             "10 orientation 0 180 -90\n"
+    );
+
+    UASensorsOrientation *s = ua_sensors_orientation_new();
+    EXPECT_TRUE(s != NULL);
+    float value;
+    EXPECT_EQ(U_STATUS_SUCCESS, ua_sensors_orientation_get_max_value(s, &value));
+    EXPECT_FLOAT_EQ(360, value);
+    ua_sensors_orientation_enable(s);
+
+    ua_sensors_orientation_set_reading_cb(s,
+        [](UASOrientationEvent* ev, void* ctx) {
+            float azimuth, pitch, roll;
+            uas_orientation_event_get_azimuth(ev, &azimuth);
+            uas_orientation_event_get_pitch(ev, &pitch);
+            uas_orientation_event_get_roll(ev, &roll);
+            events.push({uas_orientation_event_get_timestamp(ev),
+                         azimuth, pitch, roll,
+                         (UASProximityDistance) 0, ctx});
+        }, NULL);
+
+    usleep(100000);
+    ASSERT_EQ(2, events.size());
+
+    auto e = events.front();
+    events.pop();
+    EXPECT_FLOAT_EQ(270, e.x);
+    EXPECT_FLOAT_EQ(-45.5, e.y);
+    EXPECT_FLOAT_EQ(10, e.z);
+
+    e = events.front();
+    EXPECT_FLOAT_EQ(0, e.x);
+    EXPECT_FLOAT_EQ(180, e.y);
+    EXPECT_FLOAT_EQ(-90, e.z);
+})
+
+TESTP_F(SimBackendTest, CommandParsing, {
+    set_data("create light -10 10 1   # trailing comment\r\n"
+             "\n \t\n"
+             "# comment line\n"
+             "20 light 2.5e-1\r\n"
+             "20\tlight  -.75 # comment\n"
+             "20 light 1E1\n"
+             // rounding to double first would be off by one unit in the last place
+             "20 light 4.25021699629724e-03"
+    );
+
+    UASensorsLight *s = ua_sensors_light_new();
+    EXPECT_TRUE(s != NULL);
+    ua_sensors_light_enable(s);
+
+    ua_sensors_light_set_reading_cb(s,
+        [](UASLightEvent* ev, void* ctx) {
+            float light = -1.f;
+            uas_light_event_get_light(ev, &light);
+            events.push({uas_light_event_get_timestamp(ev),
+                         light, .0, .0,
+                         (UASProximityDistance) 0, ctx});
+        }, NULL);
+
+    usleep(150000);
+    ASSERT_EQ(4, events.size());
+    EXPECT_FLOAT_EQ(0.25, events.front().x);
+    events.pop();
+    EXPECT_FLOAT_EQ(-0.75, events.front().x);
+    events.pop();
+    EXPECT_FLOAT_EQ(10, events.front().x);
+    events.pop();
+    EXPECT_EQ(strtof("4.25021699629724e-03", NULL), events.front().x);
+    events.pop();
+})
+
 TESTP_F(SimBackendTest, AccelEvents, {
     // cover the case of > 1 s, to ensure that we correctly do mod arithmetic
     set_data("create accel -1000 1000 0.1\n"
@@ -266,3 +376,1060 @@ TESTP_F(SimBackendTest, AccelEvents, {
     EXPECT_GE(delay, 1050);
     EXPECT_LE(delay, 1150);
 })
+
+TESTP_F(SimBackendTest, HighRateEvents, {
+    string data = "create accel -1000 1000 0.1\n";
+    for (int i = 1; i <= 200; i++)
+        data += "0.5 accel " + to_string(i) + " 0 0\n";
+    set_data(data.c_str());
+
+    UASensorsAccelerometer *s = ua_sensors_accelerometer_new();
+    EXPECT_TRUE(s != NULL);
+    ua_sensors_accelerometer_enable(s);
+
+    ua_sensors_accelerometer_set_reading_cb(s,
+        [](UASAccelerometerEvent* ev, void* ctx) {
+            float x;
+            uas_accelerometer_event_get_acceleration_x(ev, &x);
+            events.push({uas_accelerometer_event_get_timestamp(ev),
+                         x, .0, .0,
+                         (UASProximityDistance) 0, ctx});
+        }, NULL);
+
+    usleep(250000);
+    ASSERT_EQ(200, events.size());
+
+    uint64_t first = events.front().timestamp;
+    uint64_t last = first;
+    for (int i = 1; i <= 200; i++) {
+        EXPECT_FLOAT_EQ(i, events.front().x);
+        last = events.front().timestamp;
+        events.pop();
+    }
+
+    // deadlines are absolute, so the spacing does not drift
+    auto span = chrono::duration_cast<chrono::milliseconds>(chrono::nanoseconds(last - first)).count();
+    EXPECT_GE(span, 98);
+    EXPECT_LE(span, 110);
+})
+
+TESTP_F(SimBackendTest, PerSensorTiming, {
+    // 100 Hz accelerometer and 20 Hz light sensor, written one after the other
+    string data = "create accel -1000 1000 0.1\n"
+                  "create light 0 10 1\n"
+                  "timing per-sensor\n";
+    for (int i = 1; i <= 20; i++)
+        data += "10 accel " + to_string(i) + " 0 0\n";
+    for (int i = 1; i <= 4; i++)
+        data += "50 light " + to_string(i) + "\n";
+    set_data(data.c_str());
+
+    UASensorsAccelerometer *accel = ua_sensors_accelerometer_new();
+    UASensorsLight *light = ua_sensors_light_new();
+    EXPECT_TRUE(accel != NULL);
+    EXPECT_TRUE(light != NULL);
+    ua_sensors_accelerometer_enable(accel);
+    ua_sensors_light_enable(light);
+
+    ua_sensors_accelerometer_set_reading_cb(accel,
+        [](UASAccelerometerEvent* ev, void* ctx) {
+            float x;
+            uas_accelerometer_event_get_acceleration_x(ev, &x);
+            events.push({uas_accelerometer_event_get_timestamp(ev),
+                         x, .0, .0,
+                         (UASProximityDistance) 0, ctx});
+        }, accel);
+    ua_sensors_light_set_reading_cb(light,
+        [](UASLightEvent* ev, void* ctx) {
+            float x;
+            uas_light_event_get_light(ev, &x);
+            events.push({uas_light_event_get_timestamp(ev),
+                         x, .0, .0,
+                         (UASProximityDistance) 0, ctx});
+        }, light);
+
+    usleep(250000);
+    ASSERT_EQ(24, events.size());
+
+    // merged in time order: every fifth accelerometer event is followed by a light event
+    uint64_t start = events.front().timestamp - 10000000;
+    int accel_count = 0;
+    int light_count = 0;
+    uint64_t previous = 0;
+    while (!events.empty()) {
+        auto e = events.front();
+        events.pop();
+        EXPECT_GE(e.timestamp, previous);
+        previous = e.timestamp;
+
+        if (e.context == accel) {
+            accel_count++;
+            EXPECT_FLOAT_EQ(accel_count, e.x);
+            EXPECT_EQ(accel_count * 10000000ULL, e.timestamp - start);
+        } else {
+            EXPECT_EQ(light, e.context);
+            light_count++;
+            EXPECT_FLOAT_EQ(light_count, e.x);
+            EXPECT_EQ(light_count * 50000000ULL, e.timestamp - start);
+            EXPECT_EQ(5 * light_count, accel_count);
+        }
+    }
+    EXPECT_EQ(20, accel_count);
+    EXPECT_EQ(4, light_count);
+})
+
+TESTP_F(SimBackendTest, GeneratedEvents, {
+    // 5 Hz sine at 1 kHz for 100 ms, then a ramp at 100 Hz
+    set_data("create accel -1000 1000 0.1\n"
+             "gen accel sine 5 2 1000 100\n"
+             "gen accel ramp 0 10 100 100\n"
+             "1 accel 42 0 0\n"
+    );
+
+    UASensorsAccelerometer *s = ua_sensors_accelerometer_new();
+    EXPECT_TRUE(s != NULL);
+    ua_sensors_accelerometer_enable(s);
+
+    ua_sensors_accelerometer_set_reading_cb(s,
+        [](UASAccelerometerEvent* ev, void* ctx) {
+            float x, z;
+            uas_accelerometer_event_get_acceleration_x(ev, &x);
+            uas_accelerometer_event_get_acceleration_z(ev, &z);
+            events.push({uas_accelerometer_event_get_timestamp(ev),
+                         x, .0, z,
+                         (UASProximityDistance) 0, ctx});
+        }, NULL);
+
+    usleep(300000);
+    ASSERT_EQ(111, events.size());
+
+    uint64_t start = events.front().timestamp - 1000000;
+    for (int i = 1; i <= 100; i++) {
+        auto e = events.front();
+        events.pop();
+        EXPECT_EQ(i * 1000000ULL, e.timestamp - start);
+        EXPECT_NEAR(2 * sin(2 * M_PI * 5 * i / 1000.), e.x, 1e-4);
+        EXPECT_FLOAT_EQ(e.x, e.z);
+    }
+    for (int i = 1; i <= 10; i++) {
+        auto e = events.front();
+        events.pop();
+        EXPECT_EQ(100000000ULL + i * 10000000ULL, e.timestamp - start);
+        EXPECT_FLOAT_EQ(i, e.x);
+    }
+
+    // explicit events continue after the last sample
+    EXPECT_FLOAT_EQ(42, events.front().x);
+    EXPECT_EQ(201000000ULL, events.front().timestamp - start);
+})
+
+// waveforms that can leave the range of the sensor type, or have extra values
+static const char* invalid_generators[] = {
+    "create orientation 0 360 0.1\ngen orientation sine 1 400 100 1000\n",
+    "create orientation 0 360 0.1\ngen orientation ramp 0 100 100 100\n",
+    "create rotation_vector -1 1 0.001\ngen rotation_vector noise 2 100 100\n",
+    "create rotation_vector -1 1 0.001\ngen rotation_vector walk 0.01 100 1000\n",
+    "create accel -1000 1000 0.1\ngen accel sine 5 2 1000 100 7\n",
+};
+
+TESTP_F(SimBackendTest, GeneratedEventsValidation, {
+    // invalid gen commands abort the replay
+    for (const char* data : invalid_generators) {
+        pid_t child = fork();
+        ASSERT_NE(-1, child);
+        if (child == 0) {
+            // the data of each child starts with its own create command
+            char path[] = "/tmp/sensor_test.XXXXXX";
+            int fd = mkstemp(path);
+            write(fd, data, strlen(data));
+            close(fd);
+            setenv("UBUNTU_PLATFORM_API_SENSOR_TEST", path, 1);
+            ua_sensors_accelerometer_new();
+            // commands are parsed by a worker thread
+            usleep(200000);
+            unlink(path);
+            _exit(0);
+        }
+
+        int status;
+        ASSERT_EQ(child, waitpid(child, &status, 0));
+        EXPECT_TRUE(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT) << data;
+    }
+
+    set_data("create orientation 0 360 0.1\n"
+             "create rotation_vector -1 1 0.001\n"
+             "gen orientation ramp 0 90 100 50\n"
+             "gen rotation_vector noise 0.5 100 50\n"
+    );
+
+    UASensorsOrientation *s = ua_sensors_orientation_new();
+    EXPECT_TRUE(s != NULL);
+    ua_sensors_orientation_enable(s);
+    ua_sensors_orientation_set_reading_cb(s,
+        [](UASOrientationEvent* ev, void* ctx) {
+            float azimuth;
+            uas_orientation_event_get_azimuth(ev, &azimuth);
+            events.push({uas_orientation_event_get_timestamp(ev),
+                         azimuth, .0, .0,
+                         (UASProximityDistance) 0, ctx});
+        }, NULL);
+
+    usleep(200000);
+    ASSERT_EQ(5, events.size());
+    for (int i = 1; i <= 5; i++) {
+        EXPECT_FLOAT_EQ(18 * i, events.front().x);
+        events.pop();
+    }
+})
+
+TESTP_F(SimBackendTest, ReplaySpeed, {
+    // one event at twice the speed, nine unthrottled, then ten at ten times the speed
+    string data = "create accel -1000 1000 0.1\n"
+                  "100 accel 1 0 0\n"
+                  "speed unthrottled\n";
+    for (int i = 2; i <= 10; i++)
+        data += "100 accel " + to_string(i) + " 0 0\n";
+    data += "speed 10\n";
+    for (int i = 11; i <= 20; i++)
+        data += "100 accel " + to_string(i) + " 0 0\n";
+    set_data(data.c_str());
+    setenv("UBUNTU_PLATFORM_API_SENSOR_TEST_SPEED", "2", 1);
+
+    UASensorsAccelerometer *s = ua_sensors_accelerometer_new();
+    EXPECT_TRUE(s != NULL);
+    ua_sensors_accelerometer_enable(s);
+
+    ua_sensors_accelerometer_set_reading_cb(s,
+        [](UASAccelerometerEvent* ev, void* ctx) {
+            float x;
+            uas_accelerometer_event_get_acceleration_x(ev, &x);
+            events.push({uas_accelerometer_event_get_timestamp(ev),
+                         x, .0, .0,
+                         (UASProximityDistance) 0, ctx});
+        }, NULL);
+
+    usleep(25000);
+    EXPECT_EQ(0, events.size());
+
+    usleep(50000);
+    EXPECT_GE(events.size(), 10);
+    EXPECT_LT(events.size(), 20);
+
+    usleep(125000);
+    ASSERT_EQ(20, events.size());
+
+    // timestamps keep the original spacing
+    uint64_t previous = events.front().timestamp;
+    EXPECT_FLOAT_EQ(1, events.front().x);
+    events.pop();
+    for (int i = 2; i <= 20; i++) {
+        EXPECT_FLOAT_EQ(i, events.front().x);
+        EXPECT_EQ(100000000, events.front().timestamp - previous);
+        previous = events.front().timestamp;
+        events.pop();
+    }
+})
+
+TESTP_F(SimBackendTest, VirtualClock, {
+    set_data("create accel -1000 1000 0.1\n"
+             "10 accel 1 0 0\n"
+             "10 accel 2 0 0\n"
+             "speed 0.001\n"
+             "gen accel step 5 6 1000 100\n");
+    setenv("UBUNTU_PLATFORM_API_SENSOR_TEST_CLOCK", "virtual", 1);
+
+    UASensorsAccelerometer *s = ua_sensors_accelerometer_new();
+    EXPECT_TRUE(s != NULL);
+    ua_sensors_accelerometer_enable(s);
+
+    ua_sensors_accelerometer_set_reading_cb(s,
+        [](UASAccelerometerEvent* ev, void* ctx) {
+            float x;
+            uas_accelerometer_event_get_acceleration_x(ev, &x);
+            events.push({uas_accelerometer_event_get_timestamp(ev),
+                         x, .0, .0,
+                         (UASProximityDistance) 0, ctx});
+        }, NULL);
+
+    // nothing happens until the clock gets advanced
+    usleep(20000);
+    EXPECT_EQ(0, events.size());
+
+    // each call delivers exactly the events up to the new time
+    EXPECT_EQ(U_STATUS_SUCCESS, ua_sensors_test_context_advance_clock(NULL, 15000000));
+    ASSERT_EQ(1, events.size());
+    EXPECT_EQ(10000000, events.front().timestamp);
+    EXPECT_FLOAT_EQ(1, events.front().x);
+    events.pop();
+
+    EXPECT_EQ(U_STATUS_SUCCESS, ua_sensors_test_context_advance_clock(NULL, 10000000));
+    ASSERT_EQ(6, events.size());
+    EXPECT_EQ(20000000, events.front().timestamp);
+    EXPECT_FLOAT_EQ(2, events.front().x);
+    events.pop();
+
+    // the speed does not matter, timestamps follow the data
+    EXPECT_EQ(U_STATUS_SUCCESS, ua_sensors_test_context_advance_clock(NULL, 1000000000));
+    ASSERT_EQ(100, events.size());
+    for (uint64_t i = 1; i <= 100; i++) {
+        EXPECT_EQ(20000000 + i * 1000000, events.front().timestamp);
+        events.pop();
+    }
+})
+
+namespace trace = ubuntu::application::sensors::trace;
+
+// an accelerometer and a light sensor with three events, 20 ms apart
+struct TraceData {
+    trace::Header header;
+    trace::Sensor sensors[2];
+    trace::Record records[3];
+};
+
+static trace::Record trace_record(uint64_t time, uint32_t type, float x, float y, float z)
+{
+    trace::Record record = { time, type, { x, y, z } };
+    return record;
+}
+
+static TraceData trace_data()
+{
+    TraceData data;
+    memset(&data, 0, sizeof(data));
+    memcpy(data.header.magic, trace::magic, sizeof(trace::magic));
+    data.header.version = trace::version;
+    data.header.byte_order = trace::byte_order_mark;
+    data.header.sensor_count = 2;
+    data.header.record_size = sizeof(trace::Record);
+    data.header.record_count = 3;
+    data.header.records_offset = trace::records_offset(2);
+
+    data.sensors[0] = { ubuntu::application::sensors::sensor_type_accelerometer, -1000, 1000, 0.1 };
+    data.sensors[1] = { ubuntu::application::sensors::sensor_type_light, 0, 10, 1 };
+    data.records[0] = trace_record(20000000, ubuntu::application::sensors::sensor_type_accelerometer, 1, 2, 3);
+    data.records[1] = trace_record(40000000, ubuntu::application::sensors::sensor_type_light, 5, 0, 0);
+    data.records[2] = trace_record(60000000, ubuntu::application::sensors::sensor_type_accelerometer, 4, 5, 6);
+    return data;
+}
+
+TESTP_F(SimBackendTest, BinaryTrace, {
+    TraceData data = trace_data();
+    ASSERT_EQ(offsetof(TraceData, records), data.header.records_offset);
+    set_data(&data, sizeof(data));
+
+    UASensorsAccelerometer *s = ua_sensors_accelerometer_new();
+    EXPECT_TRUE(s != NULL);
+    float value;
+    EXPECT_EQ(U_STATUS_SUCCESS, ua_sensors_accelerometer_get_max_value(s, &value));
+    EXPECT_FLOAT_EQ(1000, value);
+    EXPECT_TRUE(ua_sensors_light_new() != NULL);
+    EXPECT_TRUE(ua_sensors_proximity_new() == NULL);
+    ua_sensors_accelerometer_enable(s);
+
+    ua_sensors_accelerometer_set_reading_cb(s,
+        [](UASAccelerometerEvent* ev, void* ctx) {
+            float x, y, z;
+            uas_accelerometer_event_get_acceleration_x(ev, &x);
+            uas_accelerometer_event_get_acceleration_y(ev, &y);
+            uas_accelerometer_event_get_acceleration_z(ev, &z);
+            events.push({uas_accelerometer_event_get_timestamp(ev),
+                         x, y, z,
+                         (UASProximityDistance) 0, ctx});
+        }, NULL);
+
+    usleep(120000);
+    ASSERT_EQ(2, events.size());
+    EXPECT_FLOAT_EQ(1, events.front().x);
+    EXPECT_FLOAT_EQ(3, events.front().z);
+    uint64_t first = events.front().timestamp;
+    events.pop();
+    EXPECT_FLOAT_EQ(4, events.front().x);
+    EXPECT_FLOAT_EQ(6, events.front().z);
+    auto delay = chrono::duration_cast<chrono::milliseconds>(chrono::nanoseconds(events.front().timestamp - first)).count();
+    EXPECT_GE(delay, 39);
+    EXPECT_LE(delay, 45);
+})
+
+TESTP_F(SimBackendTest, AccelBatchEvents, {
+    set_data("create accel -1000 1000 0.1\n"
+             "20 accel 1 2 3\n"
+             "20 accel 4 5 6\n"
+    );
+
+    UASensorsAccelerometer *s = ua_sensors_accelerometer_new();
+    EXPECT_TRUE(s != NULL);
+    ua_sensors_accelerometer_enable(s);
+
+    ua_sensors_accelerometer_set_batch_reading_cb(s,
+        [](const UASVectorBatch* batch, void* ctx) {
+            for (uint32_t i = 0; i < batch->count; i++)
+                events.push({batch->timestamp[i],
+                             batch->x[i],
+                             batch->y[i],
+                             batch->z[i],
+                             (UASProximityDistance) 0, ctx});
+        }, NULL);
+
+    usleep(100000);
+    EXPECT_EQ(2, events.size());
+
+    auto e = events.front();
+    events.pop();
+    EXPECT_FLOAT_EQ(e.x, 1);
+    EXPECT_FLOAT_EQ(e.y, 2);
+    EXPECT_FLOAT_EQ(e.z, 3);
+    EXPECT_EQ(NULL, e.context);
+
+    auto e2 = events.front();
+    events.pop();
+    EXPECT_FLOAT_EQ(e2.x, 4);
+    EXPECT_FLOAT_EQ(e2.y, 5);
+    EXPECT_FLOAT_EQ(e2.z, 6);
+    EXPECT_GT(e2.timestamp, e.timestamp);
+})
+
+TESTP_F(SimBackendTest, AccelBatching, {
+    set_data("create accel -1000 1000 0.1\n"
+             "20 accel 1 1 1\n"
+             "20 accel 2 2 2\n"
+             "20 accel 3 3 3\n"
+             "200 accel 4 4 4\n"
+    );
+
+    UASensorsAccelerometer *s = ua_sensors_accelerometer_new();
+    EXPECT_TRUE(s != NULL);
+    EXPECT_EQ(U_STATUS_SUCCESS, ua_sensors_accelerometer_set_batching(s, 1000000, 100000000));
+    ua_sensors_accelerometer_enable(s);
+
+    static queue<uint32_t> batch_sizes;
+    ua_sensors_accelerometer_set_batch_reading_cb(s,
+        [](const UASVectorBatch* batch, void* ctx) {
+            batch_sizes.push(batch->count);
+            for (uint32_t i = 0; i < batch->count; i++)
+                events.push({batch->timestamp[i],
+                             batch->x[i], batch->y[i], batch->z[i],
+                             (UASProximityDistance) 0, ctx});
+        }, NULL);
+
+    // still held back in the emulated FIFO
+    usleep(90000);
+    EXPECT_EQ(0, events.size());
+
+    // flushed once the first one has been held for the maximum latency
+    usleep(110000);
+    ASSERT_EQ(1, batch_sizes.size());
+    EXPECT_EQ(3, batch_sizes.front());
+    batch_sizes.pop();
+    ASSERT_EQ(3, events.size());
+
+    // the last one is flushed without a newer event arriving
+    usleep(250000);
+    ASSERT_EQ(1, batch_sizes.size());
+    EXPECT_EQ(1, batch_sizes.front());
+    ASSERT_EQ(4, events.size());
+
+    for (int i = 1; i <= 4; i++) {
+        EXPECT_FLOAT_EQ(events.front().x, i);
+        events.pop();
+    }
+})
+
+TESTP_F(SimBackendTest, AccelBatchingFlush, {
+    set_data("create accel -1000 1000 0.1\n"
+             "20 accel 1 1 1\n"
+             "20 accel 2 2 2\n"
+             "200 accel 3 3 3\n"
+             "20 accel 4 4 4\n"
+    );
+
+    UASensorsAccelerometer *s = ua_sensors_accelerometer_new();
+    EXPECT_TRUE(s != NULL);
+    EXPECT_EQ(U_STATUS_SUCCESS, ua_sensors_accelerometer_set_batching(s, 0, 10000000000ULL));
+    ua_sensors_accelerometer_enable(s);
+
+    static queue<uint32_t> batch_sizes;
+    ua_sensors_accelerometer_set_batch_reading_cb(s,
+        [](const UASVectorBatch* batch, void* ctx) {
+            batch_sizes.push(batch->count);
+            for (uint32_t i = 0; i < batch->count; i++)
+                events.push({batch->timestamp[i],
+                             batch->x[i], batch->y[i], batch->z[i],
+                             (UASProximityDistance) 0, ctx});
+        }, NULL);
+
+    usleep(100000);
+    EXPECT_EQ(0, events.size());
+
+    // disabling hands out the queued events right away
+    ua_sensors_accelerometer_disable(s);
+    ASSERT_EQ(1, batch_sizes.size());
+    EXPECT_EQ(2, batch_sizes.front());
+    batch_sizes.pop();
+    ua_sensors_accelerometer_enable(s);
+
+    usleep(200000);
+    EXPECT_EQ(2, events.size());
+
+    // so does switching batching off
+    EXPECT_EQ(U_STATUS_SUCCESS, ua_sensors_accelerometer_set_batching(s, 0, 0));
+    ASSERT_EQ(1, batch_sizes.size());
+    EXPECT_EQ(2, batch_sizes.front());
+    ASSERT_EQ(4, events.size());
+
+    for (int i = 1; i <= 4; i++) {
+        EXPECT_FLOAT_EQ(events.front().x, i);
+        events.pop();
+    }
+})
+
+TESTP_F(SimBackendTest, AccelSamplingPeriod, {
+    string data("create accel -1000 1000 0.1\n");
+    for (int i = 1; i <= 10; i++)
+        data += "20 accel " + to_string(i) + " 0 0\n";
+    set_data(data.c_str());
+
+    UASensorsAccelerometer *s = ua_sensors_accelerometer_new();
+    EXPECT_TRUE(s != NULL);
+    // sample every 50 ms out of events every 20 ms
+    EXPECT_EQ(U_STATUS_SUCCESS, ua_sensors_accelerometer_set_batching(s, 50000000, 0));
+    ua_sensors_accelerometer_enable(s);
+
+    ua_sensors_accelerometer_set_reading_cb(s,
+        [](UASAccelerometerEvent* ev, void* ctx) {
+            float x;
+            uas_accelerometer_event_get_acceleration_x(ev, &x);
+            events.push({uas_accelerometer_event_get_timestamp(ev),
+                         x, .0, .0,
+                         (UASProximityDistance) 0, ctx});
+        }, NULL);
+
+    usleep(300000);
+    ASSERT_EQ(4, events.size());
+    for (int i = 1; i <= 10; i += 3) {
+        EXPECT_FLOAT_EQ(events.front().x, i);
+        events.pop();
+    }
+})
+
+TESTP_F(SimBackendTest, DeferredDelivery, {
+    set_data("create light 0 10 1\n"
+             "20 light 1\n"
+             "20 light 2\n"
+             "20 light 3\n"
+    );
+
+    UASensorsLight *s = ua_sensors_light_new();
+    EXPECT_TRUE(s != NULL);
+    EXPECT_EQ(-1, ua_sensors_get_delivery_fd(s));
+    EXPECT_EQ(U_STATUS_SUCCESS, ua_sensors_set_delivery_mode(s, U_SENSORS_DELIVERY_DEFERRED));
+    ua_sensors_light_enable(s);
+
+    ua_sensors_light_set_reading_cb(s,
+        [](UASLightEvent* ev, void* ctx) {
+            float light = -1.f;
+            uas_light_event_get_light(ev, &light);
+            events.push({uas_light_event_get_timestamp(ev),
+                         light, .0, .0,
+                         (UASProximityDistance) 0, ctx});
+        }, NULL);
+
+    struct pollfd pfd;
+    pfd.fd = ua_sensors_get_delivery_fd(s);
+    pfd.events = POLLIN;
+    ASSERT_GE(pfd.fd, 0);
+    ASSERT_EQ(1, poll(&pfd, 1, 1000));
+
+    // nothing is delivered behind our back
+    usleep(100000);
+    EXPECT_EQ(0, events.size());
+
+    EXPECT_EQ(3, ua_sensors_dispatch_pending(s));
+    ASSERT_EQ(3, events.size());
+    for (int i = 1; i <= 3; i++) {
+        EXPECT_FLOAT_EQ(events.front().x, i);
+        events.pop();
+    }
+
+    EXPECT_EQ(0, poll(&pfd, 1, 0));
+    EXPECT_EQ(0, ua_sensors_dispatch_pending(s));
+    EXPECT_EQ(0, ua_sensors_get_dropped_readings(s));
+})
+
+TESTP_F(SimBackendTest, Decimation, {
+    set_data("create light 0 10 1\n"
+             "20 light 1\n"
+             "20 light 2\n"
+             "20 light 3\n"
+             "20 light 4\n"
+             "20 light 5\n"
+    );
+
+    UASensorsLight *s = ua_sensors_light_new();
+    EXPECT_TRUE(s != NULL);
+    EXPECT_EQ(U_STATUS_SUCCESS, ua_sensors_set_decimation(s, 30000000, U_SENSORS_FILTER_BOXCAR, 0.f));
+    ua_sensors_light_enable(s);
+
+    ua_sensors_light_set_reading_cb(s,
+        [](UASLightEvent* ev, void* ctx) {
+            float light = -1.f;
+            uas_light_event_get_light(ev, &light);
+            events.push({uas_light_event_get_timestamp(ev),
+                         light, .0, .0,
+                         (UASProximityDistance) 0, ctx});
+        }, NULL);
+
+    usleep(300000);
+
+    // every other event, averaged with the one dropped before it
+    ASSERT_EQ(3, events.size());
+    EXPECT_FLOAT_EQ(1, events.front().x);
+    events.pop();
+    EXPECT_FLOAT_EQ(2.5, events.front().x);
+    events.pop();
+    EXPECT_FLOAT_EQ(4.5, events.front().x);
+    events.pop();
+})
+
+TESTP_F(SimBackendTest, DecimationProximity, {
+    set_data("create proximity\n");
+
+    UASensorsProximity *s = ua_sensors_proximity_new();
+    EXPECT_TRUE(s != NULL);
+    EXPECT_EQ(U_STATUS_ERROR, ua_sensors_set_decimation(s, 30000000, U_SENSORS_FILTER_LOW_PASS, 0.f));
+    EXPECT_EQ(U_STATUS_SUCCESS, ua_sensors_set_decimation(s, 30000000, U_SENSORS_FILTER_NONE, 0.f));
+})
+
+TESTP_F(SimBackendTest, Statistics, {
+    set_data("create light 0 10 1\n"
+             "20 light 1\n"
+             "20 light 2\n"
+             "20 light 3\n"
+             "20 light 4\n"
+    );
+
+    UASensorsLight *s = ua_sensors_light_new();
+    EXPECT_TRUE(s != NULL);
+    EXPECT_EQ(U_STATUS_SUCCESS, ua_sensors_set_decimation(s, 30000000, U_SENSORS_FILTER_NONE, 0.f));
+    ua_sensors_light_enable(s);
+
+    ua_sensors_light_set_reading_cb(s,
+        [](UASLightEvent*, void*) { usleep(1000); }, NULL);
+
+    usleep(200000);
+
+    UASensorsStats stats;
+    EXPECT_EQ(U_STATUS_ERROR, ua_sensors_get_stats(s, NULL));
+    ASSERT_EQ(U_STATUS_SUCCESS, ua_sensors_get_stats(s, &stats));
+    EXPECT_EQ(4u, stats.received);
+    EXPECT_EQ(2u, stats.decimated);
+    EXPECT_EQ(0u, stats.dropped);
+    EXPECT_EQ(2u, stats.delivered);
+    EXPECT_EQ(2u, stats.callbacks);
+
+    uint64_t histogram_total = 0;
+    for (int i = 0; i < U_SENSORS_LATENCY_BUCKETS; i++)
+        histogram_total += stats.latency_histogram[i];
+    EXPECT_EQ(stats.delivered, histogram_total);
+    EXPECT_LE(stats.max_latency, stats.total_latency);
+
+    // the callback sleeps for 1 ms
+    EXPECT_GE(stats.max_callback_time, 1000000u);
+    EXPECT_GE(stats.total_callback_time, 2000000u);
+    EXPECT_LE(stats.max_callback_time, stats.total_callback_time);
+})
+
+TESTP_F(SimBackendTest, StatisticsVirtualClock, {
+    set_data("create accel -1000 1000 0.1\n"
+             "10 accel 1 0 0\n"
+             "10 accel 2 0 0\n"
+             "10 accel 3 0 0\n"
+             "10 accel 4 0 0\n"
+             "10 accel 5 0 0\n"
+    );
+    setenv("UBUNTU_PLATFORM_API_SENSOR_TEST_CLOCK", "virtual", 1);
+
+    UASensorsAccelerometer *s = ua_sensors_accelerometer_new();
+    EXPECT_TRUE(s != NULL);
+    EXPECT_EQ(U_STATUS_SUCCESS, ua_sensors_accelerometer_set_batching(s, 0, 25000000));
+    ua_sensors_accelerometer_enable(s);
+    ua_sensors_accelerometer_set_reading_cb(s, [](UASAccelerometerEvent*, void*) {}, NULL);
+
+    EXPECT_EQ(U_STATUS_SUCCESS, ua_sensors_test_context_advance_clock(NULL, 100000000));
+
+    // held in the FIFO until 35 ms and 65 ms, with the clock standing still while delivering
+    UASensorsStats stats;
+    ASSERT_EQ(U_STATUS_SUCCESS, ua_sensors_get_stats(s, &stats));
+    EXPECT_EQ(5u, stats.delivered);
+    EXPECT_EQ(25000000u, stats.max_latency);
+    EXPECT_EQ(85000000u, stats.total_latency);
+})
+
+// callbacks that verify they are invoked with their own context
+static int first_context, second_context;
+static uint32_t callback_count, context_mismatches;
+
+static void first_callback(UASAccelerometerEvent*, void* ctx)
+{
+    __atomic_add_fetch(&callback_count, 1, __ATOMIC_RELAXED);
+    if (ctx != &first_context)
+        __atomic_add_fetch(&context_mismatches, 1, __ATOMIC_RELAXED);
+}
+
+static void second_callback(UASAccelerometerEvent*, void* ctx)
+{
+    __atomic_add_fetch(&callback_count, 1, __ATOMIC_RELAXED);
+    if (ctx != &second_context)
+        __atomic_add_fetch(&context_mismatches, 1, __ATOMIC_RELAXED);
+}
+
+TESTP_F(SimBackendTest, ConcurrentCallbackUpdates, {
+    set_data("create accel -1 1 0.01\n"
+             "gen accel sine 10 1 10000 200\n");
+
+    UASensorsAccelerometer *s = ua_sensors_accelerometer_new();
+    EXPECT_TRUE(s != NULL);
+    ua_sensors_accelerometer_set_reading_cb(s, first_callback, &first_context);
+    ua_sensors_accelerometer_enable(s);
+
+    // swap callbacks and read the current value while events are delivered
+    auto until = chrono::steady_clock::now() + chrono::milliseconds(150);
+    thread other([s, until] {
+        for (int i = 0; chrono::steady_clock::now() < until; i++) {
+            if (i % 2)
+                ua_sensors_accelerometer_set_reading_cb(s, first_callback, &first_context);
+            else
+                ua_sensors_accelerometer_set_reading_cb(s, second_callback, &second_context);
+            ua_sensors_accelerometer_enable(s);
+        }
+    });
+
+    while (chrono::steady_clock::now() < until) {
+        float x = 2;
+        uas_accelerometer_event_get_acceleration_x(s, &x);
+        EXPECT_LE(fabs(x), 1.f);
+    }
+    other.join();
+
+    EXPECT_GT(__atomic_load_n(&callback_count, __ATOMIC_RELAXED), 1000u);
+    EXPECT_EQ(0u, __atomic_load_n(&context_mismatches, __ATOMIC_RELAXED));
+})
+
+struct ContextReadings {
+    float expected;
+    uint32_t count;
+    uint32_t mismatches;
+};
+
+static void context_callback(UASAccelerometerEvent* ev, void* ctx)
+{
+    ContextReadings* readings = static_cast<ContextReadings*>(ctx);
+    float x;
+    uas_accelerometer_event_get_acceleration_x(ev, &x);
+    if (x != readings->expected)
+        __atomic_add_fetch(&readings->mismatches, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&readings->count, 1, __ATOMIC_RELAXED);
+}
+
+static void write_fifo(const char* path, const char* commands)
+{
+    int fd = open(path, O_WRONLY);
+    ASSERT_GE(fd, 0);
+    EXPECT_EQ(ssize_t(strlen(commands)), write(fd, commands, strlen(commands)));
+    close(fd);
+}
+
+// each thread feeds its own context and only sees its own sensor's events
+static void run_context(ContextReadings* readings, string* fifo_path)
+{
+    UASensorsTestContext* context = ua_sensors_test_context_new(NULL);
+    ASSERT_TRUE(context != NULL);
+    EXPECT_EQ(U_STATUS_SUCCESS, ua_sensors_test_context_make_current(context));
+    *fifo_path = ua_sensors_test_context_get_fifo_path(context);
+
+    write_fifo(fifo_path->c_str(), "create accel -100 100 1\n");
+    UASensorsAccelerometer *s = ua_sensors_accelerometer_new();
+    EXPECT_TRUE(s != NULL);
+    ua_sensors_accelerometer_set_reading_cb(s, context_callback, readings);
+    ua_sensors_accelerometer_enable(s);
+
+    stringstream events;
+    for (int i = 0; i < 5; i++)
+        events << "5 accel " << readings->expected << " 0 0\n";
+    write_fifo(fifo_path->c_str(), events.str().c_str());
+
+    auto until = chrono::steady_clock::now() + chrono::seconds(2);
+    while (__atomic_load_n(&readings->count, __ATOMIC_RELAXED) < 5 && chrono::steady_clock::now() < until)
+        this_thread::sleep_for(chrono::milliseconds(5));
+
+    ua_sensors_test_context_make_current(NULL);
+    ua_sensors_test_context_destroy(context);
+}
+
+TESTP_F(SimBackendTest, ParallelContexts, {
+    ContextReadings readings[4];
+    string fifo_paths[4];
+    vector<thread> threads;
+    for (int i = 0; i < 4; i++) {
+        readings[i].expected = i + 1;
+        readings[i].count = 0;
+        readings[i].mismatches = 0;
+        threads.push_back(thread(run_context, &readings[i], &fifo_paths[i]));
+    }
+    for (auto& t : threads)
+        t.join();
+
+    for (int i = 0; i < 4; i++) {
+        EXPECT_EQ(5u, readings[i].count);
+        EXPECT_EQ(0u, readings[i].mismatches);
+        for (int j = 0; j < i; j++)
+            EXPECT_NE(fifo_paths[j], fifo_paths[i]);
+    }
+
+    // unbound threads still use the environment-configured context, which has no sensors
+    EXPECT_EQ(NULL, ua_sensors_accelerometer_new());
+})
+
+TESTP_F(SimBackendTest, ContextClocks, {
+    set_data("create accel -1000 1000 0.1\n"
+             "10 accel 1 0 0\n");
+
+    // a virtual clock, although the environment asks for real time
+    UASensorsTestContext* context = ua_sensors_test_context_new_with_clock(data_file, U_SENSORS_TEST_CLOCK_VIRTUAL);
+    ASSERT_TRUE(context != NULL);
+    EXPECT_EQ(U_STATUS_SUCCESS, ua_sensors_test_context_make_current(context));
+
+    UASensorsAccelerometer *s = ua_sensors_accelerometer_new();
+    EXPECT_TRUE(s != NULL);
+    ua_sensors_accelerometer_enable(s);
+    ua_sensors_accelerometer_set_reading_cb(s,
+        [](UASAccelerometerEvent* ev, void* ctx) {
+            float x;
+            uas_accelerometer_event_get_acceleration_x(ev, &x);
+            events.push({uas_accelerometer_event_get_timestamp(ev),
+                         x, .0, .0,
+                         (UASProximityDistance) 0, ctx});
+        }, NULL);
+
+    usleep(50000);
+    EXPECT_EQ(0, events.size());
+    EXPECT_EQ(U_STATUS_SUCCESS, ua_sensors_test_context_advance_clock(context, 20000000));
+    ASSERT_EQ(1, events.size());
+    EXPECT_EQ(10000000, events.front().timestamp);
+
+    ua_sensors_test_context_make_current(NULL);
+    ua_sensors_test_context_destroy(context);
+
+    // the environment only provides the default
+    EXPECT_EQ(U_STATUS_ERROR, ua_sensors_test_context_advance_clock(NULL, 20000000));
+
+    setenv("UBUNTU_PLATFORM_API_SENSOR_TEST_CLOCK", "bogus", 1);
+    EXPECT_EQ(NULL, ua_sensors_test_context_new(data_file));
+    context = ua_sensors_test_context_new_with_clock(data_file, U_SENSORS_TEST_CLOCK_REAL);
+    ASSERT_TRUE(context != NULL);
+    EXPECT_EQ(U_STATUS_ERROR, ua_sensors_test_context_advance_clock(context, 20000000));
+    ua_sensors_test_context_destroy(context);
+})
+
+TESTP_F(SimBackendTest, ContextCreationFailure, {
+    EXPECT_EQ(NULL, ua_sensors_test_context_new("/nonexistent/sensor-script"));
+
+    // the named pipe of the first dynamic context of this process is taken
+    stringstream ss;
+    ss << "/tmp/sensor-fifo-" << getpid() << "-1";
+    const string taken = ss.str();
+    int fd = open(taken.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0600);
+    ASSERT_GE(fd, 0);
+    close(fd);
+
+    EXPECT_EQ(NULL, ua_sensors_test_context_new(NULL));
+    // somebody else's file is left alone
+    EXPECT_EQ(0, access(taken.c_str(), F_OK));
+    unlink(taken.c_str());
+
+    UASensorsTestContext* context = ua_sensors_test_context_new(NULL);
+    ASSERT_TRUE(context != NULL);
+    ua_sensors_test_context_destroy(context);
+})
+
+TESTP_F(SimBackendTest, OverriddenModules, {
+    setenv("UBUNTU_PLATFORM_API_TEST_OVERRIDE", "sensors, location", 1);
+    set_data("create accel -1000 1000 0.1\n");
+
+    const char* modules[1];
+    EXPECT_EQ(2u, u_application_list_overridden_modules(modules, 1));
+    EXPECT_STREQ("sensors", modules[0]);
+
+    const char* all[4];
+    ASSERT_EQ(2u, u_application_list_overridden_modules(all, 4));
+    EXPECT_STREQ("sensors", all[0]);
+    EXPECT_STREQ("location", all[1]);
+
+    // overridden modules keep working
+    EXPECT_TRUE(ua_sensors_accelerometer_new() != NULL);
+})
+
+TESTP_F(SimBackendTest, RoutedModule, {
+    // without a default backend only the routed modules are served
+    unsetenv("UBUNTU_PLATFORM_API_BACKEND");
+    setenv("UBUNTU_PLATFORM_API_BACKEND_ROUTES", "# simulated sensors\nsensors = test, location=test\n", 1);
+    set_data("create accel -1000 1000 0.1\n");
+
+    UASensorsAccelerometer* s = ua_sensors_accelerometer_new();
+    ASSERT_TRUE(s != NULL);
+    float max = 0.f;
+    EXPECT_EQ(U_STATUS_SUCCESS, ua_sensors_accelerometer_get_max_value(s, &max));
+    EXPECT_FLOAT_EQ(1000, max);
+})
+
+TESTP_F(SimBackendTest, MissingRoutedBackend, {
+    // a missing routed backend falls back to the default one, not the test backend
+    unsetenv("UBUNTU_PLATFORM_API_BACKEND");
+    setenv("UBUNTU_PLATFORM_API_BACKEND_ROUTES", "sensors=tuch", 1);
+    set_data("create accel -1000 1000 0.1\n");
+
+    EXPECT_EQ(NULL, ua_sensors_accelerometer_new());
+})
+
+TESTP_F(SimBackendTest, NullBackend, {
+    // neither a backend nor routes, assuming no application.conf is installed
+    unsetenv("UBUNTU_PLATFORM_API_BACKEND");
+    unsetenv("UBUNTU_PLATFORM_API_BACKEND_ROUTES");
+
+    EXPECT_EQ(NULL, u_application_lifecycle_delegate_new());
+    // the slot stays NULL after binding
+    EXPECT_EQ(NULL, u_application_lifecycle_delegate_new());
+})
+
+TESTP_F(SimBackendTest, PreloadBackend, {
+    set_data("create accel -1000 1000 0.1\n");
+
+    UApplicationPreloadTimes times;
+    u_application_preload_backend(&times);
+    EXPECT_GT(times.load_time, 0u);
+    EXPECT_GT(times.bind_time, 0u);
+    EXPECT_NE(0, times.resolved_now);
+
+    // preloading again reports the initial load
+    UApplicationPreloadTimes again;
+    u_application_preload_backend(&again);
+    EXPECT_EQ(times.config_time, again.config_time);
+    EXPECT_EQ(times.load_time, again.load_time);
+    EXPECT_EQ(times.bind_time, again.bind_time);
+    EXPECT_EQ(times.resolved_now, again.resolved_now);
+
+    EXPECT_TRUE(ua_sensors_accelerometer_new() != NULL);
+})
+
+TESTP_F(SimBackendTest, PreloadAfterLazyLoad, {
+    set_data("create accel -1000 1000 0.1\n");
+
+    // the first call loads the backend lazily
+    EXPECT_TRUE(ua_sensors_accelerometer_new() != NULL);
+
+    UApplicationPreloadTimes times;
+    u_application_preload_backend(&times);
+    EXPECT_EQ(0, times.resolved_now);
+
+    EXPECT_TRUE(ua_sensors_accelerometer_new() != NULL);
+})
+
+TESTP_F(SimBackendTest, MultiplexerPublishing, {
+    char segment[64];
+    snprintf(segment, sizeof(segment), "/sensor-mux-test-%d", getpid());
+    setenv("UBUNTU_PLATFORM_API_SENSOR_MULTIPLEXER", segment, 1);
+
+    set_data("create accel -1000 1000 0.1\n"
+             "create proximity\n"
+             "20 accel 1 2 3\n"
+             "20 proximity far\n"
+    );
+
+    // readings are published even if no local sensor is enabled
+    UASensorsAccelerometer *s = ua_sensors_accelerometer_new();
+    EXPECT_TRUE(s != NULL);
+
+    namespace mux = ubuntu::application::sensors::multiplexer;
+    unique_ptr<mux::Subscriber> subscriber(mux::Subscriber::open(segment));
+    ASSERT_TRUE(subscriber != NULL);
+
+    const mux::SensorDescription& accel = subscriber->meta().sensors[ubuntu::application::sensors::sensor_type_accelerometer];
+    EXPECT_EQ(1u, accel.present);
+    EXPECT_FLOAT_EQ(-1000, accel.min_value);
+    EXPECT_FLOAT_EQ(1000, accel.max_value);
+    EXPECT_EQ(0u, subscriber->meta().sensors[ubuntu::application::sensors::sensor_type_light].present);
+
+    vector<mux::Reading> readings;
+    mux::Reading r;
+    while (readings.size() < 2 && subscriber->wait(1000))
+        while (subscriber->next(r))
+            readings.push_back(r);
+
+    ASSERT_EQ(2, readings.size());
+    EXPECT_EQ(ubuntu::application::sensors::sensor_type_accelerometer, readings[0].type);
+    EXPECT_FLOAT_EQ(1, readings[0].values[0]);
+    EXPECT_FLOAT_EQ(2, readings[0].values[1]);
+    EXPECT_FLOAT_EQ(3, readings[0].values[2]);
+    EXPECT_EQ(ubuntu::application::sensors::sensor_type_proximity, readings[1].type);
+    EXPECT_FLOAT_EQ(1, readings[1].values[0]);
+    EXPECT_GT(readings[1].timestamp, readings[0].timestamp);
+    EXPECT_EQ(0u, subscriber->overrun_count());
+    EXPECT_TRUE(subscriber->publisher_alive());
+})
+
+TESTP_F(SimBackendTest, MultiplexerPublisherCrash, {
+    char segment[64];
+    snprintf(segment, sizeof(segment), "/sensor-mux-crash-%d", getpid());
+
+    namespace mux = ubuntu::application::sensors::multiplexer;
+
+    // the publisher exits without removing its segment
+    pid_t child = fork();
+    ASSERT_GE(child, 0);
+    if (child == 0) {
+        mux::Publisher* publisher = mux::Publisher::create(segment);
+        if (publisher == NULL)
+            _exit(1);
+        publisher->start();
+        _exit(0);
+    }
+
+    int status;
+    ASSERT_EQ(child, waitpid(child, &status, 0));
+    ASSERT_TRUE(WIFEXITED(status));
+    ASSERT_EQ(0, WEXITSTATUS(status));
+
+    unique_ptr<mux::Subscriber> subscriber(mux::Subscriber::open(segment));
+    ubuntu::platform::detail::unlink_segment(segment);
+    ASSERT_TRUE(subscriber != NULL);
+    EXPECT_FALSE(subscriber->wait(10));
+    EXPECT_FALSE(subscriber->publisher_alive());
+})
+
+TESTP_F(SimBackendTest, MultiplexerSegmentOwnership, {
+    char segment[64];
+    snprintf(segment, sizeof(segment), "/sensor-mux-link-%d", getpid());
+    char path[PATH_MAX];
+    ASSERT_TRUE(ubuntu::platform::detail::segment_path(segment, path, sizeof(path)));
+
+    namespace mux = ubuntu::application::sensors::multiplexer;
+
+    // a planted symlink is replaced instead of followed
+    ASSERT_EQ(0, symlink(data_file, path));
+    set_data("create accel -1000 1000 0.1\n");
+
+    unique_ptr<mux::Publisher> publisher(mux::Publisher::create(segment));
+    ASSERT_TRUE(publisher != NULL);
+    publisher->start();
+
+    struct stat st;
+    ASSERT_EQ(0, lstat(path, &st));
+    EXPECT_TRUE(S_ISREG(st.st_mode));
+    ASSERT_EQ(0, stat(data_file, &st));
+    EXPECT_EQ(28, st.st_size);
+
+    EXPECT_TRUE(unique_ptr<mux::Subscriber>(mux::Subscriber::open(segment)) != NULL);
+
+    // segments that others can write to are not trusted
+    ASSERT_EQ(0, chmod(path, 0666));
+    EXPECT_TRUE(unique_ptr<mux::Subscriber>(mux::Subscriber::open(segment)) == NULL);
+})